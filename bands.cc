@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <stdexcept>
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  typedef cl::kernel_functor<cl::buffer, uint32_t, uint32_t, uint32_t,
+    cl::buffer, cl::buffer, cl::buffer, cl::buffer, cl::buffer, cl::buffer,
+    cl::buffer> band_run;
+
+  /* Rows row0 to row0 + rows - 1 of the lattice, swept on their own queue.
+   * The band keeps its rows in buffers of its own, together with the row
+   * below and the row above, which the neighbouring bands copy their edge
+   * rows into after every sweep.
+   */
+  class band {
+    public:
+    cl::queue queue;
+    /* Where the copies into the halo rows go. On an in-order queue they
+     * would wait behind the rows between, so such bands get a second queue
+     * on the same device.
+     */
+    cl::queue exchange;
+    std::size_t row0, rows;
+    /* Even sweeps go from the first buffer to the second */
+    std::vector<cl::buffer> lattice;
+    cl::buffer diffs;
+    cl::buffer below, above;
+    /* New values of the first and last rows, for the neighbours */
+    cl::buffer edge_low, edge_high;
+    /* The first and last rows, and the rows between, of a sweep from
+     * lattice[i]
+     */
+    std::vector<band_run> edge_runs, interior_runs;
+    residual_monitor residual;
+    /* What the rows between wait for next: the last sweep or residual
+     * check. The edge rows also wait for the copies of the last exchange.
+     * Both lists live as long as the band, so once they have grown to hold
+     * a full exchange they are refilled without allocating.
+     */
+    cl::wait_list sweeps, edge_deps;
+
+    band(solver_env &env, const cl::queue &q, std::size_t first,
+        std::size_t count);
+
+    //! Enqueue the sweep from lattice[n % 2], returns the edge rows event
+    cl::event sweep(unsigned n);
+
+    //! Enqueue a residual check of the last sweep
+    void check(void);
+
+    //! Make the next sweep wait for ev, or only its edge rows if halo is set
+    void wait_for(const cl::event &ev, bool halo = false);
+  };
+
+  cl::queue make_exchange_queue(const cl::context &context,
+      const cl::queue &q)
+  {
+    const unsigned int props = q.properties();
+    if(props & cl::queue::QUEUE_OUT_OF_ORDER) {
+      return q;
+    }
+
+    cl::queue ret = cl::queue::create(context, q.get_device(), props);
+    ret.set_profiler(q.get_profiler());
+    return ret;
+  }
+
+  band_run make_band_run(solver_env &env, const band &b,
+      const cl::buffer &input, const cl::buffer &output, uint32_t row0,
+      uint32_t row_step, std::size_t count)
+  {
+    const std::size_t dims[2] = { env.params.global_dims[0], count };
+    band_run run(env.get_kernel("jacobi_band_step"), 2, dims);
+    run.bind(env.params_buf, b.rows, row0, row_step, input, b.below, b.above,
+        output, b.diffs, b.edge_low, b.edge_high);
+
+    return run;
+  }
+
+  band::band(solver_env &env, const cl::queue &q, std::size_t first,
+      std::size_t count)
+    : queue(q)
+    , exchange(make_exchange_queue(env.context, q))
+    , row0(first)
+    , rows(count)
+    , lattice()
+    , diffs(env.lease(rows*env.params.global_row_stride*env.real_size))
+    , below(env.lease(env.params.global_row_stride*env.real_size))
+    , above(env.lease(env.params.global_row_stride*env.real_size))
+    , edge_low(env.lease(env.params.global_row_stride*env.real_size))
+    , edge_high(env.lease(env.params.global_row_stride*env.real_size))
+    , residual(env, diffs, env.params.global_dims[0],
+        env.params.global_row_stride, rows,
+        defaults::get().local_size().dim[0]*
+        defaults::get().local_size().dim[1])
+  {
+    lattice.push_back(env.lease(rows*env.params.global_row_stride*
+          env.real_size));
+    lattice.push_back(env.lease(rows*env.params.global_row_stride*
+          env.real_size));
+
+    for(unsigned i = 0; i < 2; ++i) {
+      const cl::buffer &input = lattice[i], &output = lattice[1 - i];
+      // A single row is its own first and last row
+      edge_runs.push_back(make_band_run(env, *this, input, output, 0,
+            rows > 1 ? rows - 1 : 1, rows > 1 ? 2 : 1));
+      if(rows > 2) {
+        interior_runs.push_back(make_band_run(env, *this, input, output, 1, 1,
+              rows - 2));
+      }
+    }
+  }
+
+  cl::event band::sweep(unsigned n)
+  {
+    cl::event edges = edge_runs[n % 2](queue, edge_deps);
+    edge_deps.clear();
+    edge_deps.push_back(edges);
+    // The rows between never see the halo, so they need not wait for the
+    // exchange and run while it is in flight.
+    if(!interior_runs.empty()) {
+      edge_deps.push_back(interior_runs[n % 2](queue, sweeps));
+    }
+    sweeps = edge_deps;
+
+    return edges;
+  }
+
+  void band::check(void)
+  {
+    cl::event reduced = residual.check(queue, queue.marker(sweeps));
+    sweeps.clear();
+    wait_for(reduced);
+  }
+
+  void band::wait_for(const cl::event &ev, bool halo)
+  {
+    if(!halo) {
+      sweeps.push_back(ev);
+    }
+    edge_deps.push_back(ev);
+  }
+
+  /* Sweep all bands once, then copy the new edge rows of every band into the
+   * halo rows of its neighbours. Each copy goes to the exchange queue of the
+   * band it writes, once both bands have swept their edge rows. edges is
+   * scratch space of the caller, reused from sweep to sweep.
+   */
+  void sweep_all(std::vector<band> &bands, unsigned n, std::size_t row_bytes,
+      std::vector<cl::event> &edges)
+  {
+    edges.clear();
+    for(std::size_t b = 0; b < bands.size(); ++b) {
+      edges.push_back(bands[b].sweep(n));
+      // Other queues wait on the edge rows, which needs them submitted
+      bands[b].queue.flush();
+    }
+
+    for(std::size_t b = 0; b < bands.size(); ++b) {
+      band &bd = bands[b];
+      if(b > 0) {
+        cl::wait_list after(edges[b - 1]);
+        after.push_back(edges[b]);
+        cl::event ev = bd.exchange.add(cl::buffer_copy(bands[b - 1].edge_high,
+              bd.below, row_bytes), after);
+        bd.wait_for(ev, true);
+        bands[b - 1].wait_for(ev, true);
+      }
+      if(b + 1 < bands.size()) {
+        cl::wait_list after(edges[b + 1]);
+        after.push_back(edges[b]);
+        cl::event ev = bd.exchange.add(cl::buffer_copy(bands[b + 1].edge_low,
+              bd.above, row_bytes), after);
+        bd.wait_for(ev, true);
+        bands[b + 1].wait_for(ev, true);
+      }
+      bd.exchange.flush();
+    }
+  }
+
+  /* Norms of the whole lattice from the outstanding checks of the bands */
+  void wait_norms(std::vector<band> &bands, solve_result &result)
+  {
+    double l2 = 0.0;
+    result.linf = 0.0f;
+    for(std::size_t b = 0; b < bands.size(); ++b) {
+      residual_monitor &residual = bands[b].residual;
+      residual.wait();
+      l2 += static_cast<double>(residual.l2())*residual.l2();
+      result.linf = std::max(result.linf, residual.linf());
+    }
+    result.l2 = std::sqrt(l2);
+  }
+}
+
+solve_result solve_bands(solver_env &env, const cl::buffer &state,
+    const cl::event &start)
+{
+  if(env.problems.size() != 1) {
+    throw std::runtime_error("banded solves need a single problem");
+  }
+
+  // One band per queue, as long as each gets an interior row
+  const std::size_t interior = env.params.global_dims[1] - 2;
+  const std::size_t count = std::min(env.queues.size(), interior);
+  const std::size_t row_bytes = env.params.global_row_stride*env.real_size;
+  std::vector<band> bands;
+  bands.reserve(count);
+  for(std::size_t b = 0; b < count; ++b) {
+    const std::size_t first = 1 + b*interior/count;
+    const std::size_t last = 1 + (b + 1)*interior/count;
+    bands.push_back(band(env, env.queues[b], first, last - first));
+    if(defaults::get().verbose()) {
+      std::cerr << "Band " << b << ": rows " << first << " to " <<
+        last - 1 << " on '" << env.queues[b].get_device().name() << '\'' <<
+        std::endl;
+    }
+  }
+
+  // Scatter the lattice from the first queue, then move each band to its
+  // device ahead of the first sweep.
+  for(std::size_t b = 0; b < bands.size(); ++b) {
+    band &bd = bands[b];
+    cl::wait_list copies;
+    copies.push_back(env.queue.add(cl::buffer_copy(state, bd.lattice[0],
+            bd.rows*row_bytes, bd.row0*row_bytes), start));
+    copies.push_back(env.queue.add(cl::buffer_copy(state, bd.below,
+            row_bytes, (bd.row0 - 1)*row_bytes), start));
+    copies.push_back(env.queue.add(cl::buffer_copy(state, bd.above,
+            row_bytes, (bd.row0 + bd.rows)*row_bytes), start));
+    env.queue.flush();
+
+    std::vector<cl::buffer> bufs(bd.lattice);
+    bufs.push_back(bd.diffs);
+    bufs.push_back(bd.below);
+    bufs.push_back(bd.above);
+    bufs.push_back(bd.edge_low);
+    bufs.push_back(bd.edge_high);
+    bd.wait_for(bd.queue.migrate(bufs, cl::queue::MIGRATE_TO_DEVICE,
+          copies));
+  }
+
+  // Residual checks run as in iterate(), the norms of the bands adding up
+  // to those of the lattice.
+  const unsigned max_iterations = defaults::get().max_iterations();
+  const unsigned check_interval = defaults::get().check_interval();
+  unsigned checked = 0, next_check = check_interval;
+  std::vector<cl::event> edges;
+  edges.reserve(bands.size());
+  solve_result result(state);
+  while(!result.converged && result.iterations < max_iterations) {
+    const unsigned steps = std::min(next_check, max_iterations) -
+      result.iterations;
+    for(unsigned i = 0; i < steps; ++i) {
+      sweep_all(bands, result.iterations + i, row_bytes, edges);
+    }
+    result.iterations += steps;
+    while(next_check <= result.iterations) {
+      next_check += check_interval;
+    }
+    if(bands.front().residual.pending_check()) {
+      wait_norms(bands, result);
+      result.converged = result.linf <= defaults::get().tolerance();
+      if(defaults::get().verbose()) {
+        std::cerr << "Iteration " << checked << ": L2 residual " <<
+          result.l2 << ", max residual " << result.linf << std::endl;
+      }
+    }
+    for(std::size_t b = 0; b < bands.size(); ++b) {
+      bands[b].check();
+      bands[b].queue.flush();
+    }
+    checked = result.iterations;
+  }
+
+  // Gather the bands back into state, the boundary rows never changed
+  std::vector<cl::event> gathered;
+  for(std::size_t b = 0; b < bands.size(); ++b) {
+    band &bd = bands[b];
+    gathered.push_back(env.queue.add(cl::buffer_copy(
+            bd.lattice[result.iterations % 2], state, bd.rows*row_bytes, 0,
+            bd.row0*row_bytes), bd.edge_deps));
+  }
+  cl::event::wait_all(gathered);
+  wait_norms(bands, result);
+  result.converged = result.linf <= defaults::get().tolerance();
+
+  return result;
+}
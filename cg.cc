@@ -0,0 +1,162 @@
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  /* Lattice kernels run with the lattice work groups, finish kernels as a
+   * single work group of the same shape.
+   */
+  cl::nd_run lattice_run(const cl::kernel &k)
+  {
+    return cl::nd_run(k, defaults::get().global_size().dim,
+        defaults::get().local_size().dim);
+  }
+
+  cl::nd_run finish_run(const cl::kernel &k)
+  {
+    return cl::nd_run(k, defaults::get().local_size().dim,
+        defaults::get().local_size().dim);
+  }
+
+  cl::local_space group_scratch(const solver_env &env)
+  {
+    return cl::local_space(env.real_size*
+        defaults::get().local_size().dim[0]*
+        defaults::get().local_size().dim[1]);
+  }
+
+  /* Kernel with params in front and scratch at the back */
+  cl::kernel bound_kernel(solver_env &env, const std::string &name,
+      const std::vector<cl::buffer> &args)
+  {
+    cl::kernel k = env.get_kernel(name);
+    k.argv()[0] <<= env.params_buf;
+    for(unsigned i = 0; i < args.size(); ++i) {
+      k.argv()[i + 1] <<= args[i];
+    }
+    if(k.argc() > args.size() + 1) {
+      k.argv()[args.size() + 1] <<= group_scratch(env);
+    }
+
+    return k;
+  }
+
+  std::vector<cl::buffer> buffers(const cl::buffer &a, const cl::buffer &b)
+  {
+    std::vector<cl::buffer> ret;
+    ret.push_back(a);
+    ret.push_back(b);
+
+    return ret;
+  }
+
+  std::vector<cl::buffer> buffers(const cl::buffer &a, const cl::buffer &b,
+      const cl::buffer &c)
+  {
+    std::vector<cl::buffer> ret = buffers(a, b);
+    ret.push_back(c);
+
+    return ret;
+  }
+
+  std::vector<cl::buffer> buffers(const cl::buffer &a, const cl::buffer &b,
+      const cl::buffer &c, const cl::buffer &d)
+  {
+    std::vector<cl::buffer> ret = buffers(a, b, c);
+    ret.push_back(d);
+
+    return ret;
+  }
+
+  std::vector<cl::buffer> buffers(const cl::buffer &a, const cl::buffer &b,
+      const cl::buffer &c, const cl::buffer &d, const cl::buffer &e,
+      const cl::buffer &f)
+  {
+    std::vector<cl::buffer> ret = buffers(a, b, c, d);
+    ret.push_back(e);
+    ret.push_back(f);
+
+    return ret;
+  }
+
+  /* All vectors and scalars stay on the device, alpha and beta are computed
+   * there too, so an iteration is five launches and no host round trip.
+   */
+  class cg_sweeper : public sweeper {
+    private:
+    std::vector<cl::nd_run> runs;
+    cl::command_list iteration;
+
+    public:
+    cg_sweeper(solver_env &env, const cl::buffer &u,
+        const cl::buffer &r, const cl::buffer &p, const cl::buffer &q,
+        const cl::buffer &partial, const cl::buffer &scalars)
+    {
+      runs.push_back(lattice_run(bound_kernel(env, "cg_apply",
+              buffers(p, q, partial))));
+      runs.push_back(finish_run(bound_kernel(env, "cg_alpha",
+              buffers(partial, scalars))));
+      runs.push_back(lattice_run(bound_kernel(env, "cg_update",
+              buffers(scalars, p, q, u, r, partial))));
+      runs.push_back(finish_run(bound_kernel(env, "cg_beta",
+              buffers(partial, scalars))));
+      runs.push_back(lattice_run(bound_kernel(env, "cg_direction",
+              buffers(scalars, r, p))));
+      for(std::size_t i = 0; i < runs.size(); ++i) {
+        iteration.add(runs[i], i > 0 ? cl::command_list::dependencies(1,
+              i - 1) : cl::command_list::dependencies());
+      }
+    }
+
+    cl::event step(cl::queue &q, unsigned, const cl::event &after)
+    {
+      cl::event ev = after;
+      for(std::vector<cl::nd_run>::const_iterator run = runs.begin();
+          run != runs.end(); ++run) {
+        ev = q.add(*run, ev);
+      }
+
+      return ev;
+    }
+
+    cl::event steps(cl::queue &q, unsigned, unsigned count,
+        const cl::event &after)
+    {
+      return iteration.replay(q, count, after);
+    }
+  };
+}
+
+solve_result solve_cg(solver_env &env, const cl::buffer &state,
+    const cl::event &start)
+{
+  const std::size_t groups =
+    defaults::get().global_size().dim[0]/defaults::get().local_size().dim[0]*
+    (defaults::get().global_size().dim[1]/defaults::get().local_size().dim[1]);
+
+  cl::buffer r = env.lease(env.lattice_bytes());
+  cl::buffer p = env.lease(env.lattice_bytes());
+  cl::buffer q = env.lease(env.lattice_bytes());
+  cl::buffer partial = env.lease(groups*env.real_size);
+  cl::buffer scalars = env.lease(4*env.real_size);
+
+  cl::event ev = env.queue.add(lattice_run(bound_kernel(env, "cg_start",
+          buffers(state, r, p, partial))), start);
+  ev = env.queue.add(finish_run(bound_kernel(env, "cg_start_finish",
+          buffers(partial, scalars))), ev);
+
+  cg_sweeper sweeps(env, state, r, p, q, partial, scalars);
+  /* The residual of the scaled problem is the change a Jacobi sweep would
+   * make, so the usual tolerance applies.
+   */
+  residual_monitor residual(env, r,
+      env.params.global_dims[0], env.params.global_row_stride,
+      env.params.global_dims[1],
+      defaults::get().local_size().dim[0]*defaults::get().local_size().dim[1]);
+
+  solve_result result(state);
+  iterate(env, sweeps, residual, ev, defaults::get().check_interval(),
+      result);
+
+  return result;
+}
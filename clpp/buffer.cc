@@ -1,9 +1,76 @@
+#include <cstdlib>
 #include <iostream>
+#ifdef _WIN32
+#  include <malloc.h>
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <unistd.h>
+#endif
 
 #include "error.hh"
 #include "buffer_internal.hh"
 #include "context_internal.hh"
 
+namespace {
+  /* Transparent huge pages are 2 MiB on the common platforms */
+  const std::size_t huge_page_size = 2*1024*1024;
+
+  std::size_t page_size(void)
+  {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return sysconf(_SC_PAGESIZE);
+#endif
+  }
+
+  /* Allocate whole pages for at least cb bytes. Huge pages are only asked
+   * for, the allocation succeeds without them.
+   */
+  void *alloc_pages(std::size_t cb, bool huge)
+  {
+    const std::size_t align = huge ? huge_page_size : page_size();
+    const std::size_t bytes = (cb + align - 1)/align*align;
+
+#ifdef _WIN32
+    void *p = _aligned_malloc(bytes, align);
+    if(!p) {
+      throw cl::error("unable to allocate host memory for buffer");
+    }
+#else
+    void *p = NULL;
+    if(posix_memalign(&p, align, bytes) != 0) {
+      throw cl::error("unable to allocate host memory for buffer");
+    }
+#  ifdef MADV_HUGEPAGE
+    if(huge) {
+      madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#  endif
+#endif
+
+    return p;
+  }
+
+  void free_pages(void *p)
+  {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    std::free(p);
+#endif
+  }
+
+  /* Host memory passed to a buffer goes with the buffer */
+  void CL_CALLBACK release_pages(cl_mem, void *p)
+  {
+    free_pages(p);
+  }
+}
+
 cl::mem::impl::impl(const cl_mem m, bool retain)
   : memory(m)
 {
@@ -106,16 +173,58 @@ cl::buffer::~buffer(void)
 {
 }
 
-cl::buffer cl::buffer::create(const context &c, std::size_t cb, mem_mode mode)
+cl::buffer cl::buffer::create(const context &c, std::size_t cb, mem_mode mode,
+    mem_host host)
 {
   const cl_context ctx = c.pimpl->get_context();
-  const cl_mem_flags mflag = impl::unwrap_flag(mode);
+  cl_mem_flags mflag = impl::unwrap_flag(mode);
+  void *host_ptr = NULL;
+  switch(host) {
+    case MEM_HOST_ALLOC:
+      mflag |= CL_MEM_ALLOC_HOST_PTR;
+      break;
+    case MEM_HOST_PAGES:
+    case MEM_HOST_HUGE_PAGES:
+      mflag |= CL_MEM_USE_HOST_PTR;
+      host_ptr = alloc_pages(cb, host == MEM_HOST_HUGE_PAGES);
+      break;
+    default:
+      break;
+  }
 
   cl_int cl_err = CL_SUCCESS;
-  cl_mem m = clCreateBuffer(ctx, mflag, cb, NULL, &cl_err);
+  cl_mem m = clCreateBuffer(ctx, mflag, cb, host_ptr, &cl_err);
   if(cl_err != CL_SUCCESS) {
+    free_pages(host_ptr);
     throw cl::error("unable to create buffer");
   }
+  if(host_ptr) {
+    /* From here on the buffer owns the host memory */
+    cl_err = clSetMemObjectDestructorCallback(m, release_pages, host_ptr);
+    if(cl_err != CL_SUCCESS) {
+      /* The pages may only go once nothing uses them any more */
+      clReleaseMemObject(m);
+      free_pages(host_ptr);
+      throw cl::error("unable to hand host memory to buffer");
+    }
+  }
+
+  return buffer(impl(m, false));
+}
+
+cl::buffer cl::buffer::sub_buffer(std::size_t origin, std::size_t size,
+    mem_mode mode) const
+{
+  cl_buffer_region region;
+  region.origin = origin;
+  region.size = size;
+
+  cl_int cl_err = CL_SUCCESS;
+  cl_mem m = clCreateSubBuffer(pimpl->get_mem(), impl::unwrap_flag(mode),
+      CL_BUFFER_CREATE_TYPE_REGION, &region, &cl_err);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to create sub-buffer");
+  }
 
   return buffer(impl(m, false));
 }
@@ -28,8 +28,22 @@ namespace cl {
       MEM_MODE_WO
     };
 
+    //! Where the contents of a memory object are kept
+    enum mem_host {
+      //! Wherever the implementation sees fit, usually device memory
+      MEM_HOST_NONE,
+      //! Host memory allocated by the implementation
+      MEM_HOST_ALLOC,
+      //! Page aligned host memory, which CPU devices use without copies
+      MEM_HOST_PAGES,
+      //! As MEM_HOST_PAGES, backed by huge pages where the system allows
+      MEM_HOST_HUGE_PAGES
+    };
+
     friend class kernel;
     friend class queue;
+    friend class command_list;
+    friend class buffer_map;
   };
 
   class buffer : public mem {
@@ -42,8 +56,17 @@ namespace cl {
     buffer &operator=(const buffer &b);
 
     //! Create a buffer in a given context with the given size and mode
+    /*! Buffers in host memory are best accessed through a buffer_map. */
     static buffer create(const context &c, std::size_t cb,
-        mem_mode m = MEM_MODE_RW);
+        mem_mode m = MEM_MODE_RW, mem_host h = MEM_HOST_NONE);
+
+    //! A buffer sharing size bytes of this buffer from byte origin
+    /*! origin has to be a multiple of the base address alignment of the
+     *  devices of the context. Commands on overlapping sub-buffers must not
+     *  run at the same time.
+     */
+    buffer sub_buffer(std::size_t origin, std::size_t size,
+        mem_mode m = MEM_MODE_RW) const;
 
     void swap(buffer &b);
   };
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <iomanip>
+
+#include "buffer_pool.hh"
+#include "error.hh"
+
+namespace {
+  /* Smallest size class, requests below are rounded up to it */
+  const std::size_t min_class = 4096;
+
+  /* Round cb up to a quarter step of the power of two below it */
+  std::size_t class_bytes(std::size_t cb)
+  {
+    if(cb <= min_class) {
+      return min_class;
+    }
+
+    std::size_t pow = min_class;
+    while(pow < (cb - 1)/2 + 1) {
+      pow *= 2;
+    }
+    const std::size_t step = pow/4;
+
+    return (cb + step - 1)/step*step;
+  }
+}
+
+bool cl::buffer_pool::cached_buffer::idle(void)
+{
+  for(std::size_t i = 0; i < busy.size(); ++i) {
+    if(!busy[i].completed()) {
+      return false;
+    }
+  }
+  busy.clear();
+
+  return true;
+}
+
+bool cl::buffer_pool::size_class::operator<(const size_class &sc) const
+{
+  if(bytes != sc.bytes) {
+    return bytes < sc.bytes;
+  }
+  if(mode != sc.mode) {
+    return mode < sc.mode;
+  }
+
+  return host < sc.host;
+}
+
+cl::buffer_pool::lease::lease(buffer_pool *p, const size_class &s,
+    const buffer &b)
+  : pool(p)
+  , sc(s)
+  , buf(b)
+  , busy()
+{
+}
+
+cl::buffer_pool::lease::lease(lease &&l)
+  : pool(l.pool)
+  , sc(l.sc)
+  , buf(l.buf)
+  , busy()
+{
+  busy.swap(l.busy);
+  l.pool = 0;
+}
+
+cl::buffer_pool::lease &cl::buffer_pool::lease::operator=(lease &&l)
+{
+  if(this != &l) {
+    release();
+    pool = l.pool;
+    sc = l.sc;
+    buf = l.buf;
+    busy.swap(l.busy);
+    l.pool = 0;
+  }
+
+  return *this;
+}
+
+cl::buffer_pool::lease::~lease(void)
+{
+  release();
+}
+
+const cl::buffer &cl::buffer_pool::lease::get(void) const
+{
+  return buf;
+}
+
+void cl::buffer_pool::lease::retire_after(const event &done)
+{
+  busy.push_back(done);
+}
+
+void cl::buffer_pool::lease::release(void)
+{
+  if(pool) {
+    pool->give_back(sc, buf, busy);
+    busy.clear();
+    pool = 0;
+  }
+}
+
+cl::buffer_pool::buffer_pool(const context &c, std::size_t high_water)
+  : ctx(c)
+  , counters()
+  , free_buffers()
+  , lock()
+{
+  counters.high_water = high_water;
+}
+
+/* copy constructor cl::buffer_pool::buffer_pool(const buffer_pool &)
+ * intentionally not defined
+ */
+
+cl::buffer_pool::~buffer_pool(void)
+{
+}
+
+/* assignment operator cl::buffer_pool::operator=(const buffer_pool &)
+ * intentionally not defined
+ */
+
+void cl::buffer_pool::give_back(const size_class &sc, const buffer &b,
+    const std::vector<event> &busy)
+{
+  cached_buffer cb = { b, busy };
+  std::lock_guard<std::mutex> guard(lock);
+
+  free_buffers[sc].push_back(cb);
+  counters.leased -= sc.bytes;
+  counters.cached += sc.bytes;
+}
+
+/* Release a cached buffer of the largest class, false if there is none */
+bool cl::buffer_pool::evict_one(void)
+{
+  for(free_table::reverse_iterator f = free_buffers.rbegin();
+      f != free_buffers.rend(); ++f) {
+    if(!f->second.empty()) {
+      f->second.pop_back();
+      counters.cached -= f->first.bytes;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+cl::buffer_pool::lease cl::buffer_pool::acquire(std::size_t cb,
+    mem::mem_mode m, mem::mem_host h)
+{
+  size_class sc;
+  sc.bytes = class_bytes(cb);
+  sc.mode = m;
+  sc.host = h;
+
+  std::lock_guard<std::mutex> guard(lock);
+  ++counters.requests;
+
+  std::vector<cached_buffer> &cached = free_buffers[sc];
+  for(std::size_t i = cached.size(); i-- > 0; ) {
+    if(cached[i].idle()) {
+      lease ret(this, sc, cached[i].buf);
+      cached.erase(cached.begin() + i);
+      ++counters.hits;
+      counters.cached -= sc.bytes;
+      counters.leased += sc.bytes;
+      return ret;
+    }
+  }
+
+  if(counters.high_water) {
+    /* Evicting only helps if the leased buffers leave room, and then
+     * evicting enough of the cache always does.
+     */
+    if(counters.leased + sc.bytes > counters.high_water) {
+      throw cl::error("buffer pool high-water mark exceeded");
+    }
+    while(counters.leased + counters.cached + sc.bytes >
+        counters.high_water && evict_one()) {
+    }
+  }
+
+  lease ret(this, sc, buffer::create(ctx, sc.bytes, m, h));
+  counters.leased += sc.bytes;
+  counters.peak = std::max(counters.peak, counters.leased + counters.cached);
+
+  return ret;
+}
+
+void cl::buffer_pool::trim(void)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  free_buffers.clear();
+  counters.cached = 0;
+}
+
+cl::buffer_pool::statistics cl::buffer_pool::stats(void) const
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  return counters;
+}
+
+void cl::buffer_pool::report(std::ostream &out) const
+{
+  const statistics s = stats();
+  const double mib = 1.0/(1024*1024);
+
+  out << "Buffer pool: " << s.requests << " requests, hit rate " <<
+    std::fixed << std::setprecision(1) <<
+    (s.requests ? 100.0*s.hits/s.requests : 0.0) << "%, peak " <<
+    s.peak*mib << " MiB, " << s.leased*mib << " MiB leased, " <<
+    s.cached*mib << " MiB cached";
+  if(s.high_water) {
+    out << ", high-water mark " << s.high_water*mib << " MiB";
+  }
+  out << std::endl;
+}
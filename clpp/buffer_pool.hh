@@ -0,0 +1,120 @@
+#ifndef CLPP_CL_BUFFER_POOL_HH_INCLUDED
+#define CLPP_CL_BUFFER_POOL_HH_INCLUDED
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "buffer.hh"
+#include "context.hh"
+#include "event.hh"
+
+namespace cl {
+  //! Recycles the buffers of a context
+  /*! Requests are rounded up to size classes, quarter steps between powers
+   *  of two, and served from buffers returned earlier where possible. A
+   *  lease hands its buffer back to the pool when it goes, so the pool has
+   *  to outlive its leases. A buffer returned with events is only handed
+   *  out again once they have completed, so commands still using it when
+   *  its lease goes see no other user. Its contents are only defined once
+   *  it has been written again.
+   *
+   *  The bytes held, leased and cached together, never exceed the high-water
+   *  mark; cached buffers are released to make room first.
+   */
+  class buffer_pool {
+    private:
+    struct size_class {
+      std::size_t bytes;
+      mem::mem_mode mode;
+      mem::mem_host host;
+
+      bool operator<(const size_class &sc) const;
+    };
+    /* A returned buffer and the commands which may still use it */
+    struct cached_buffer {
+      buffer buf;
+      std::vector<event> busy;
+
+      bool idle(void);
+    };
+    typedef std::map<size_class, std::vector<cached_buffer> > free_table;
+
+    public:
+    //! A buffer of the pool, given back on destruction
+    class lease {
+      private:
+      buffer_pool *pool;
+      size_class sc;
+      buffer buf;
+      std::vector<event> busy;
+
+      lease(buffer_pool *p, const size_class &s, const buffer &b);
+      lease(const lease &l);
+      lease &operator=(const lease &l);
+
+      public:
+      lease(lease &&l);
+      lease &operator=(lease &&l);
+      ~lease(void);
+
+      //! The leased buffer, at least as large as requested
+      const buffer &get(void) const;
+
+      //! Keep the buffer from other leases until done has completed
+      /*! For commands still using the buffer when it is given back. */
+      void retire_after(const event &done);
+
+      //! Give the buffer back before the lease goes
+      void release(void);
+
+      friend class buffer_pool;
+    };
+
+    //! Counters since the pool was created, sizes in bytes
+    struct statistics {
+      std::size_t requests;
+      std::size_t hits;
+      std::size_t leased;
+      std::size_t cached;
+      std::size_t peak;
+      std::size_t high_water;
+    };
+
+    private:
+    context ctx;
+    statistics counters;
+    free_table free_buffers;
+    mutable std::mutex lock;
+
+    void give_back(const size_class &sc, const buffer &b,
+        const std::vector<event> &busy);
+    bool evict_one(void);
+
+    buffer_pool(const buffer_pool &bp);
+    buffer_pool &operator=(const buffer_pool &bp);
+
+    public:
+    //! Pool for buffers of c holding at most high_water bytes, 0 for any
+    explicit buffer_pool(const context &c, std::size_t high_water = 0);
+    ~buffer_pool(void);
+
+    //! Lease a buffer of at least cb bytes
+    /*! Cached buffers still in use by commands are passed over. Throws
+     *  cl::error if the buffer would take the pool over its high-water mark.
+     */
+    lease acquire(std::size_t cb, mem::mem_mode m = mem::MEM_MODE_RW,
+        mem::mem_host h = mem::MEM_HOST_NONE);
+
+    //! Release all cached buffers
+    void trim(void);
+
+    statistics stats(void) const;
+
+    //! Print hit rate and sizes to out
+    void report(std::ostream &out) const;
+  };
+}
+
+#endif /* CLPP_CL_BUFFER_POOL_HH_INCLUDED */
@@ -2,12 +2,17 @@
 #define CLPP_CL_CLPP_HH_INCLUDED
 
 #include "buffer.hh"
+#include "buffer_pool.hh"
+#include "command_list.hh"
 #include "context.hh"
 #include "device.hh"
 #include "error.hh"
 #include "event.hh"
+#include "kernel_functor.hh"
 #include "platform.hh"
+#include "profiler.hh"
 #include "program.hh"
+#include "program_cache.hh"
 #include "queue.hh"
 
 #endif /* CLPP_CL_CLPP_HH_INCLUDED */
@@ -0,0 +1,505 @@
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <CL/cl_ext.h>
+
+#include "command_list.hh"
+#include "error.hh"
+#include "buffer_internal.hh"
+#include "event_internal.hh"
+#include "program_internal.hh"
+#include "queue_internal.hh"
+
+namespace {
+  /* Events of one pass of a replay, released when they go */
+  class event_set {
+    private:
+    std::vector<cl_event> evs;
+
+    event_set(const event_set &es);
+    event_set &operator=(const event_set &es);
+
+    public:
+    explicit event_set(std::size_t n)
+      : evs(n, static_cast<cl_event>(NULL))
+    {
+    }
+
+    ~event_set(void)
+    {
+      clear();
+    }
+
+    cl_event &operator[](std::size_t i)
+    {
+      return evs[i];
+    }
+
+    /* The non-null events */
+    std::size_t gather(std::vector<cl_event> &out) const
+    {
+      for(std::vector<cl_event>::const_iterator ev = evs.begin();
+          ev != evs.end(); ++ev) {
+        if(*ev) {
+          out.push_back(*ev);
+        }
+      }
+
+      return out.size();
+    }
+
+    void clear(void)
+    {
+      for(std::vector<cl_event>::iterator ev = evs.begin(); ev != evs.end();
+          ++ev) {
+        if(*ev && clReleaseEvent(*ev) != CL_SUCCESS) {
+          std::cerr << "unable to release event of a command list" <<
+            std::endl;
+        }
+        *ev = NULL;
+      }
+    }
+
+    void swap(event_set &es)
+    {
+      evs.swap(es.evs);
+    }
+  };
+}
+
+class cl::command_list::impl {
+  public:
+  enum kind {
+    KERNEL,
+    READ,
+    WRITE
+  };
+
+  /* A command with its OpenCL handles resolved */
+  struct command {
+    kind what;
+    /* Position of the recorded object in runs, reads or writes */
+    std::size_t slot;
+    dependencies deps;
+
+    cl_kernel kern;
+    cl_uint work_dim;
+    std::size_t global[3], local[3];
+    bool has_local;
+
+    cl_mem memobj;
+    std::size_t offset, bytes;
+    void *ptr;
+  };
+
+  std::vector<command> commands;
+  /* Keep the handles of the commands alive */
+  std::vector<nd_run> runs;
+  std::vector<buffer_read> reads;
+  std::vector<buffer_write> writes;
+
+#ifdef cl_khr_command_buffer
+  /* Command buffer of the kernels, built for cmdbuf_queue */
+  cl_command_buffer_khr cmdbuf;
+  cl_command_queue cmdbuf_queue;
+  bool cmdbuf_tried;
+  clEnqueueCommandBufferKHR_fn enqueue_cmdbuf;
+  clReleaseCommandBufferKHR_fn release_cmdbuf;
+
+  bool build_command_buffer(cl_command_queue q);
+  void drop_command_buffer(void);
+#endif
+
+  impl(void);
+  ~impl(void);
+
+  void check_deps(const dependencies &deps) const;
+
+  /* Enqueue c, ev receives its event unless it is null */
+  static void enqueue(cl_command_queue q, const command &c,
+      const std::vector<cl_event> &waits, cl_event *ev);
+};
+
+cl::command_list::impl::impl(void)
+  : commands()
+  , runs()
+  , reads()
+  , writes()
+#ifdef cl_khr_command_buffer
+  , cmdbuf(NULL)
+  , cmdbuf_queue(NULL)
+  , cmdbuf_tried(false)
+  , enqueue_cmdbuf(NULL)
+  , release_cmdbuf(NULL)
+#endif
+{
+}
+
+cl::command_list::impl::~impl(void)
+{
+#ifdef cl_khr_command_buffer
+  drop_command_buffer();
+#endif
+}
+
+void cl::command_list::impl::check_deps(const dependencies &deps) const
+{
+  for(dependencies::const_iterator d = deps.begin(); d != deps.end(); ++d) {
+    if(*d >= commands.size()) {
+      throw cl::error("command list dependency on a later command");
+    }
+  }
+}
+
+void cl::command_list::impl::enqueue(cl_command_queue q, const command &c,
+    const std::vector<cl_event> &waits, cl_event *ev)
+{
+  const cl_uint nwaits = waits.size();
+  const cl_event *wait_evs = nwaits ? &waits[0] : NULL;
+  cl_int cl_err = CL_SUCCESS;
+
+  switch(c.what) {
+    case KERNEL:
+      cl_err = clEnqueueNDRangeKernel(q, c.kern, c.work_dim, NULL, c.global,
+          c.has_local ? c.local : NULL, nwaits, wait_evs, ev);
+      break;
+    case READ:
+      cl_err = clEnqueueReadBuffer(q, c.memobj, CL_FALSE, c.offset, c.bytes,
+          c.ptr, nwaits, wait_evs, ev);
+      break;
+    case WRITE:
+      cl_err = clEnqueueWriteBuffer(q, c.memobj, CL_FALSE, c.offset, c.bytes,
+          c.ptr, nwaits, wait_evs, ev);
+      break;
+  }
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue command of a command list");
+  }
+}
+
+#ifdef cl_khr_command_buffer
+namespace {
+  template<typename fn>
+  fn extension_function(cl_platform_id plat, const char *name)
+  {
+    return reinterpret_cast<fn>(
+        clGetExtensionFunctionAddressForPlatform(plat, name));
+  }
+}
+
+bool cl::command_list::impl::build_command_buffer(cl_command_queue q)
+{
+  drop_command_buffer();
+  cmdbuf_queue = q;
+  cmdbuf_tried = true;
+
+  for(std::vector<command>::const_iterator c = commands.begin();
+      c != commands.end(); ++c) {
+    if(c->what != KERNEL) {
+      return false;
+    }
+  }
+
+  cl_device_id dev = NULL;
+  cl_platform_id plat = NULL;
+  std::size_t len = 0;
+  if(clGetCommandQueueInfo(q, CL_QUEUE_DEVICE, sizeof(dev), &dev, NULL) !=
+      CL_SUCCESS ||
+      clGetDeviceInfo(dev, CL_DEVICE_PLATFORM, sizeof(plat), &plat, NULL) !=
+      CL_SUCCESS ||
+      clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, 0, NULL, &len) !=
+      CL_SUCCESS) {
+    return false;
+  }
+  std::vector<char> exts(len + 1);
+  if(clGetDeviceInfo(dev, CL_DEVICE_EXTENSIONS, len, &exts[0], NULL) !=
+      CL_SUCCESS ||
+      !std::strstr(&exts[0], "cl_khr_command_buffer")) {
+    return false;
+  }
+
+  clCreateCommandBufferKHR_fn create = extension_function<
+    clCreateCommandBufferKHR_fn>(plat, "clCreateCommandBufferKHR");
+  clCommandNDRangeKernelKHR_fn ndrange = extension_function<
+    clCommandNDRangeKernelKHR_fn>(plat, "clCommandNDRangeKernelKHR");
+  clFinalizeCommandBufferKHR_fn finalize = extension_function<
+    clFinalizeCommandBufferKHR_fn>(plat, "clFinalizeCommandBufferKHR");
+  enqueue_cmdbuf = extension_function<clEnqueueCommandBufferKHR_fn>(plat,
+      "clEnqueueCommandBufferKHR");
+  release_cmdbuf = extension_function<clReleaseCommandBufferKHR_fn>(plat,
+      "clReleaseCommandBufferKHR");
+  if(!create || !ndrange || !finalize || !enqueue_cmdbuf || !release_cmdbuf) {
+    return false;
+  }
+
+  /* Replays enqueue the buffer again before the previous pass has finished */
+#ifdef CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR
+  const cl_command_buffer_properties_khr props[] = {
+    CL_COMMAND_BUFFER_FLAGS_KHR, CL_COMMAND_BUFFER_SIMULTANEOUS_USE_KHR, 0
+  };
+#else
+  const cl_command_buffer_properties_khr *props = NULL;
+#endif
+  cl_int cl_err = CL_SUCCESS;
+  cmdbuf = create(1, &q, props, &cl_err);
+  if(cl_err != CL_SUCCESS) {
+    cmdbuf = NULL;
+    return false;
+  }
+
+  std::vector<cl_sync_point_khr> points(commands.size());
+  std::vector<cl_sync_point_khr> waits;
+  for(std::size_t i = 0; i < commands.size() && cl_err == CL_SUCCESS; ++i) {
+    const command &c = commands[i];
+    waits.clear();
+    for(dependencies::const_iterator d = c.deps.begin(); d != c.deps.end();
+        ++d) {
+      waits.push_back(points[*d]);
+    }
+    cl_err = ndrange(cmdbuf, NULL, NULL, c.kern, c.work_dim, NULL, c.global,
+        c.has_local ? c.local : NULL, waits.size(),
+        waits.empty() ? NULL : &waits[0], &points[i], NULL);
+  }
+  if(cl_err == CL_SUCCESS) {
+    cl_err = finalize(cmdbuf);
+  }
+  if(cl_err != CL_SUCCESS) {
+    drop_command_buffer();
+    cmdbuf_queue = q;
+    cmdbuf_tried = true;
+    return false;
+  }
+
+  return true;
+}
+
+void cl::command_list::impl::drop_command_buffer(void)
+{
+  if(cmdbuf && release_cmdbuf(cmdbuf) != CL_SUCCESS) {
+    std::cerr << "unable to release command buffer" << std::endl;
+  }
+  cmdbuf = NULL;
+  cmdbuf_queue = NULL;
+  cmdbuf_tried = false;
+}
+#endif
+
+cl::command_list::command_list(void)
+  : pimpl(new impl)
+{
+}
+
+/* copy constructor cl::command_list::command_list(const command_list &)
+ * intentionally not defined
+ */
+
+cl::command_list::~command_list(void)
+{
+}
+
+/* assignment operator cl::command_list::operator=(const command_list &)
+ * intentionally not defined
+ */
+
+std::size_t cl::command_list::add(const nd_run &nd, const dependencies &deps)
+{
+  pimpl->check_deps(deps);
+
+  impl::command c = impl::command();
+  c.what = impl::KERNEL;
+  c.slot = pimpl->runs.size();
+  c.deps = deps;
+  c.kern = nd.k.pimpl->get_kernel();
+  c.work_dim = nd.wd;
+  std::copy(nd.gd.begin(), nd.gd.end(), c.global);
+  c.has_local = !nd.ld.empty();
+  std::copy(nd.ld.begin(), nd.ld.end(), c.local);
+
+  pimpl->runs.push_back(nd);
+  pimpl->commands.push_back(c);
+#ifdef cl_khr_command_buffer
+  pimpl->drop_command_buffer();
+#endif
+
+  return pimpl->commands.size() - 1;
+}
+
+std::size_t cl::command_list::add(const buffer_read &br,
+    const dependencies &deps)
+{
+  pimpl->check_deps(deps);
+
+  impl::command c = impl::command();
+  c.what = impl::READ;
+  c.slot = pimpl->reads.size();
+  c.deps = deps;
+  c.memobj = br.buf.pimpl->get_mem();
+  c.offset = br.offsetbytes;
+  c.bytes = br.bytes;
+  c.ptr = br.dst;
+
+  pimpl->reads.push_back(br);
+  pimpl->commands.push_back(c);
+#ifdef cl_khr_command_buffer
+  pimpl->drop_command_buffer();
+#endif
+
+  return pimpl->commands.size() - 1;
+}
+
+std::size_t cl::command_list::add(const buffer_write &bw,
+    const dependencies &deps)
+{
+  pimpl->check_deps(deps);
+
+  impl::command c = impl::command();
+  c.what = impl::WRITE;
+  c.slot = pimpl->writes.size();
+  c.deps = deps;
+  c.memobj = bw.buf.pimpl->get_mem();
+  c.offset = bw.offsetbytes;
+  c.bytes = bw.bytes;
+  c.ptr = bw.src;
+
+  pimpl->writes.push_back(bw);
+  pimpl->commands.push_back(c);
+#ifdef cl_khr_command_buffer
+  pimpl->drop_command_buffer();
+#endif
+
+  return pimpl->commands.size() - 1;
+}
+
+std::size_t cl::command_list::size(void) const
+{
+  return pimpl->commands.size();
+}
+
+cl::event cl::command_list::replay(queue &q, unsigned passes,
+    const wait_list &waitlist)
+{
+  const std::vector<impl::command> &commands = pimpl->commands;
+  const std::size_t n = commands.size();
+  if(passes == 0 || n == 0) {
+    return q.marker(waitlist);
+  }
+
+  /* Through queue::add so that the profiler sees the commands */
+  if(q.pimpl->get_profiler()) {
+    wait_list prev(waitlist);
+    std::vector<event> cur;
+    for(unsigned pass = 0; pass < passes; ++pass) {
+      cur.clear();
+      for(std::size_t i = 0; i < n; ++i) {
+        const impl::command &c = commands[i];
+        wait_list waits;
+        if(c.deps.empty()) {
+          waits = prev;
+        }
+        for(dependencies::const_iterator d = c.deps.begin();
+            d != c.deps.end(); ++d) {
+          waits.push_back(cur[*d]);
+        }
+        switch(c.what) {
+          case impl::KERNEL:
+            cur.push_back(q.add(pimpl->runs[c.slot], waits));
+            break;
+          case impl::READ:
+            cur.push_back(q.add(pimpl->reads[c.slot], waits));
+            break;
+          case impl::WRITE:
+            cur.push_back(q.add(pimpl->writes[c.slot], waits, false));
+            break;
+        }
+      }
+      prev = wait_list(cur);
+    }
+
+    return q.marker(prev);
+  }
+
+  const cl_command_queue cq = q.pimpl->get_command_queue();
+  const bool in_order = !(q.properties() & queue::QUEUE_OUT_OF_ORDER);
+  std::vector<cl_event> waits(waitlist.data(),
+      waitlist.data() + waitlist.size());
+  cl_event last = NULL;
+
+#ifdef cl_khr_command_buffer
+  if(pimpl->cmdbuf_queue != cq || !pimpl->cmdbuf_tried) {
+    pimpl->build_command_buffer(cq);
+  }
+  if(pimpl->cmdbuf) {
+    event_set prev(1);
+    for(unsigned pass = 0; pass < passes; ++pass) {
+      const bool last_pass = pass + 1 == passes;
+      event_set cur(1);
+      cl_int cl_err = pimpl->enqueue_cmdbuf(0, NULL, pimpl->cmdbuf,
+          waits.size(), waits.empty() ? NULL : &waits[0],
+          in_order && !last_pass ? NULL : &cur[0]);
+      if(cl_err != CL_SUCCESS) {
+        throw cl::error("unable to enqueue command buffer");
+      }
+      prev.swap(cur);
+      waits.clear();
+      if(!in_order) {
+        prev.gather(waits);
+      }
+    }
+    last = prev[0];
+    prev[0] = NULL;
+
+    return event(last);
+  }
+#endif
+
+  /* Every pass starts with the commands which depend on nothing else in the
+   * list waiting for all of the previous pass. On an in-order queue the
+   * order of enqueueing suffices and only the very last command gets an
+   * event.
+   */
+  event_set prev(n), cur(n);
+  std::vector<cl_event> deps;
+  deps.reserve(n + waits.size());
+  for(unsigned pass = 0; pass < passes; ++pass) {
+    for(std::size_t i = 0; i < n; ++i) {
+      const impl::command &c = commands[i];
+      const bool last_command = pass + 1 == passes && i + 1 == n;
+      deps.clear();
+      if(in_order) {
+        if(pass == 0 && i == 0) {
+          deps = waits;
+        }
+      } else if(c.deps.empty()) {
+        deps.insert(deps.end(), waits.begin(), waits.end());
+      } else {
+        for(dependencies::const_iterator d = c.deps.begin();
+            d != c.deps.end(); ++d) {
+          deps.push_back(cur[*d]);
+        }
+      }
+      impl::enqueue(cq, c, deps, in_order && !last_command ? NULL : &cur[i]);
+    }
+    prev.swap(cur);
+    cur.clear();
+    waits.clear();
+    prev.gather(waits);
+  }
+
+  if(in_order) {
+    last = prev[n - 1];
+    prev[n - 1] = NULL;
+  } else {
+#ifdef CL_VERSION_1_2
+    cl_int cl_err = clEnqueueMarkerWithWaitList(cq, waits.size(), &waits[0],
+        &last);
+#else
+    cl_int cl_err = clEnqueueMarker(cq, &last);
+#endif
+    if(cl_err != CL_SUCCESS) {
+      throw cl::error("unable to enqueue marker");
+    }
+  }
+
+  return event(last);
+}
@@ -0,0 +1,58 @@
+#ifndef CLPP_CL_COMMAND_LIST_HH_INCLUDED
+#define CLPP_CL_COMMAND_LIST_HH_INCLUDED
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "event.hh"
+#include "queue.hh"
+
+namespace cl {
+  //! A recorded sequence of commands which can be enqueued many times
+  /*! Commands are numbered in the order they are added and may depend on
+   *  earlier commands of the list. The OpenCL handles of every command are
+   *  resolved once when it is added, so a replay only issues the enqueue
+   *  calls. Each pass of a replay starts once the previous one has completed.
+   *
+   *  Lists of kernels only are turned into a cl_khr_command_buffer on their
+   *  first replay where the device supports it. Kernel arguments are then
+   *  captured at that point, otherwise when each command is enqueued.
+   */
+  class command_list {
+    private:
+    class impl;
+    std::auto_ptr<impl> pimpl;
+
+    command_list(const command_list &cl);
+    command_list &operator=(const command_list &cl);
+
+    public:
+    //! Indices of earlier commands a command depends on
+    typedef std::vector<std::size_t> dependencies;
+
+    command_list(void);
+    ~command_list(void);
+
+    //! Append a kernel run, returns its index
+    std::size_t add(const nd_run &nd, const dependencies &deps =
+        dependencies());
+    //! Append a non-blocking buffer read, returns its index
+    std::size_t add(const buffer_read &br, const dependencies &deps =
+        dependencies());
+    //! Append a non-blocking buffer write, returns its index
+    std::size_t add(const buffer_write &bw, const dependencies &deps =
+        dependencies());
+
+    //! Number of commands in the list
+    std::size_t size(void) const;
+
+    //! Enqueue the list passes times in a row on q, once waitlist is done
+    /*! Returns an event completing with the last pass. A profiler attached
+     *  to q sees every command, at the cost of a slower replay.
+     */
+    event replay(queue &q, unsigned passes = 1,
+        const wait_list &waitlist = wait_list());
+  };
+}
+
+#endif /* CLPP_CL_COMMAND_LIST_HH_INCLUDED */
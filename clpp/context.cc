@@ -64,9 +64,28 @@ cl::context::context(const impl &i)
 
 cl::context cl::context::create(const device &dev)
 {
+  return create(std::vector<device>(1, dev));
+}
+
+cl::context cl::context::create(const std::vector<device> &devs)
+{
+  if(devs.empty()) {
+    throw cl::error("a context needs at least one device");
+  }
+
+  std::vector<cl_device_id> dids;
+  dids.reserve(devs.size());
+  for(std::vector<device>::const_iterator d = devs.begin(); d != devs.end();
+      ++d) {
+    dids.push_back(d->pimpl->get_device());
+  }
+
   cl_int cl_err = CL_SUCCESS;
-  const cl_device_id did = dev.pimpl->get_device();
-  cl_context ctx = clCreateContext(NULL, 1, &did, NULL, NULL, &cl_err);
+  cl_context ctx = clCreateContext(NULL, dids.size(), &dids[0], NULL, NULL,
+      &cl_err);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to create context");
+  }
 
   return context(impl(ctx, false));
 }
@@ -86,3 +105,29 @@ cl::context &cl::context::operator=(const context &rhs)
 
   return *this;
 }
+
+std::vector<cl::device> cl::context::devices(void) const
+{
+  std::size_t len = 0;
+  cl_int cl_err = clGetContextInfo(pimpl->get_context(), CL_CONTEXT_DEVICES,
+      0, NULL, &len);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to determine number of context devices");
+  }
+
+  std::vector<cl_device_id> dids(len/sizeof(cl_device_id));
+  cl_err = clGetContextInfo(pimpl->get_context(), CL_CONTEXT_DEVICES, len,
+      &dids[0], NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain context devices");
+  }
+
+  std::vector<device> devs;
+  devs.reserve(dids.size());
+  for(std::vector<cl_device_id>::const_iterator did = dids.begin();
+      did != dids.end(); ++did) {
+    devs.push_back(device(device::impl(*did)));
+  }
+
+  return devs;
+}
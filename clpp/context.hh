@@ -19,12 +19,17 @@ namespace cl {
     public:
     //! Create  a context for a specific device
     static context create(const device &dev);
-    // TODO: Add a version handling a vector of devices
+    //! Create a context shared by devices of one platform
+    /*! Buffers and programs of the context can be used on any of devs. */
+    static context create(const std::vector<device> &devs);
     context(const context &ctx);
     ~context(void);
 
     context &operator=(const context &rhs);
 
+    //! Devices the context was created for
+    std::vector<device> devices(void) const;
+
     friend class program;
     friend class queue;
     friend class buffer;
@@ -1,26 +1,80 @@
+#include <iostream>
 #include <CL/cl.h>
 #include "platform_internal.hh"
 #include "device.hh"
 #include "device_internal.hh"
 #include "error.hh"
 
-cl::device::impl::impl(const cl_device_id id)
+namespace {
+  /* Root devices ignore reference counts, sub-devices only exist from
+   * OpenCL 1.2 on, so earlier headers need no counting at all.
+   */
+  cl_int retain_device(cl_device_id id)
+  {
+#ifdef CL_VERSION_1_2
+    return clRetainDevice(id);
+#else
+    return CL_SUCCESS;
+#endif
+  }
+
+  cl_int release_device(cl_device_id id)
+  {
+#ifdef CL_VERSION_1_2
+    return clReleaseDevice(id);
+#else
+    return CL_SUCCESS;
+#endif
+  }
+}
+
+cl::device::impl::impl(const cl_device_id id, bool retain)
   : did(id)
 {
+  if(retain) {
+    cl_int cl_err = retain_device(did);
+    if(cl_err != CL_SUCCESS) {
+      throw cl::error("unable to retain device");
+    }
+  }
 }
 
 cl::device::impl::impl(const impl &i)
   : did(i.did)
 {
+  cl_int cl_err = retain_device(did);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to retain device");
+  }
 }
 
 cl::device::impl &cl::device::impl::operator=(const impl &i)
 {
+  cl_int cl_err = retain_device(i.did);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to retain device");
+  }
+
+  cl_err = release_device(did);
+  if(cl_err != CL_SUCCESS) {
+    if(release_device(i.did) != CL_SUCCESS) {
+      std::cerr << "unable to release retained device" << std::endl;
+    }
+    throw cl::error("unable to release device");
+  }
+
   did = i.did;
+
+  return *this;
 }
 
 cl::device::impl::~impl(void)
 {
+  cl_int cl_err = release_device(did);
+  if(cl_err != CL_SUCCESS) {
+    std::cerr << "unable to release device in cl::device::impl::~impl" <<
+      std::endl;
+  }
 }
 
 cl_device_id cl::device::impl::get_device(void) const
@@ -91,3 +145,67 @@ std::string cl::device::driver_version(void) const
   return pimpl->get_device_string(CL_DRIVER_VERSION);
 }
 
+std::string cl::device::extensions(void) const
+{
+  return pimpl->get_device_string(CL_DEVICE_EXTENSIONS);
+}
+
+std::string cl::device::il_version(void) const
+{
+#ifdef CL_DEVICE_IL_VERSION
+  /* Devices below OpenCL 2.1 do not know the query */
+  try {
+    return pimpl->get_device_string(CL_DEVICE_IL_VERSION);
+  } catch(cl::error &) {
+    return std::string();
+  }
+#else
+  return std::string();
+#endif
+}
+
+bool cl::device::has_extension(const std::string &ext) const
+{
+  const std::string exts = " " + extensions() + " ";
+
+  return exts.find(" " + ext + " ") != std::string::npos;
+}
+
+
+std::vector<cl::device> cl::device::partition_numa(void) const
+{
+#ifdef CL_VERSION_1_2
+  const cl_device_partition_property props[] = {
+    CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN,
+    CL_DEVICE_AFFINITY_DOMAIN_NUMA,
+    0
+  };
+
+  /* Determine how many domains there are */
+  cl_uint num_devices;
+  cl_int cl_err = clCreateSubDevices(pimpl->get_device(), props, 0, NULL,
+      &num_devices);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to partition device by NUMA domain");
+  }
+
+  std::vector<cl_device_id> dids(num_devices);
+  cl_err = clCreateSubDevices(pimpl->get_device(), props, dids.size(),
+      &dids[0], NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to create sub-devices");
+  }
+
+  /* The new sub-devices come retained, hand the references over */
+  std::vector<device> devices;
+  devices.reserve(dids.size());
+  for(std::vector<cl_device_id>::const_iterator did = dids.begin();
+      did != dids.end(); ++did) {
+    devices.push_back(device(device::impl(*did, false)));
+  }
+
+  return devices;
+#else
+  throw cl::error("partitioning devices needs OpenCL 1.2");
+#endif
+}
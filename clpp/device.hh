@@ -43,6 +43,19 @@ namespace cl {
 
     std::string name(void) const;
     std::string driver_version(void) const;
+    //! Space separated list of supported extensions
+    std::string extensions(void) const;
+    //! Determine if the device supports the extension named ext
+    bool has_extension(const std::string &ext) const;
+    //! Intermediate languages accepted by program::from_il
+    /*! Empty if there are none, or the headers predate OpenCL 2.1. */
+    std::string il_version(void) const;
+
+    //! Split the device into one sub-device per NUMA domain
+    /*! Throws cl::error if the device cannot be partitioned by affinity
+     *  domain, or the headers predate OpenCL 1.2.
+     */
+    std::vector<device> partition_numa(void) const;
 
     friend class context;
     friend class program;
@@ -10,7 +10,10 @@ class cl::device::impl {
   cl_device_id did;
 
   public:
-  explicit impl(const cl_device_id id);
+  /* Call with retain = false for new sub-devices, which come retained.
+   * Root devices ignore the count either way.
+   */
+  explicit impl(const cl_device_id id, bool retain = true);
   impl(const impl &i);
   impl &operator=(const impl &i);
 
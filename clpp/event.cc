@@ -1,57 +1,106 @@
+#include <exception>
 #include <iostream>
+#include <memory>
 #include "error.hh"
 #include "event_internal.hh"
 
-cl::event::impl::impl(cl_event e, bool retain)
-  : ev(e)
-{
-  if(retain) {
+namespace {
+  void retain(cl_event ev)
+  {
     cl_int cl_err = clRetainEvent(ev);
     if(cl_err != CL_SUCCESS) {
       throw cl::error("unable to retain event");
     }
   }
+
+  /* Used from destructors, so failures are only reported */
+  void release(cl_event ev, const char *where)
+  {
+    if(ev && clReleaseEvent(ev) != CL_SUCCESS) {
+      std::cerr << "unable to release event in " << where << std::endl;
+    }
+  }
+
+  /* Owns the callback passed to clSetEventCallback */
+  void CL_CALLBACK run_callback(cl_event, cl_int status, void *data)
+  {
+    std::auto_ptr<cl::event::callback> f(
+        static_cast<cl::event::callback *>(data));
+
+    try {
+      (*f)(status == CL_COMPLETE);
+    } catch(const std::exception &e) {
+      std::cerr << "event callback failed: " << e.what() << std::endl;
+    } catch(...) {
+      std::cerr << "event callback failed" << std::endl;
+    }
+  }
+}
+
+cl::event::event(_cl_event *e)
+  : ev(e)
+{
 }
 
-cl::event::impl::impl(const impl &i)
-  : ev(i.ev)
+cl::event::event(const event &e)
+  : ev(e.ev)
 {
-  cl_int cl_err = clRetainEvent(ev);
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to retain event");
+  if(ev) {
+    retain(ev);
   }
 }
 
-cl::event::impl &cl::event::impl::operator=(const impl &i)
+cl::event::event(event &&e)
+  : ev(e.ev)
 {
-  cl_int cl_err = clRetainEvent(i.ev);
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to retain event");
-  }
+  e.ev = 0;
+}
 
-  cl_err = clReleaseEvent(ev);
-  if(cl_err != CL_SUCCESS) {
-    if(clReleaseEvent(i.ev) != CL_SUCCESS) {
-      std::cerr << "unable to release retained event" << std::endl;
-    }
-    throw cl::error("unable to release event");
-  }
+cl::event &cl::event::operator=(const event &e)
+{
+  event newe(e);
 
-  ev = i.ev;
+  swap(newe);
 
   return *this;
 }
 
-cl::event::impl::~impl(void)
+cl::event &cl::event::operator=(event &&e)
 {
+  swap(e);
+
+  return *this;
+}
+
+cl::event::~event(void)
+{
+  release(ev, "cl::event::~event");
+}
+
+void cl::event::wait(void) const
+{
+  const cl_event evs[1] = { ev };
+
+  cl_int cl_err = clWaitForEvents(1, evs);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to wait on event");
+  }
 }
 
-cl_event cl::event::impl::get_event(void) const
+void cl::event::wait_all(const wait_list &evs)
 {
-  return ev;
+  if(evs.empty()) {
+    return;
+  }
+
+  int cl_err = clWaitForEvents(evs.size(), evs.data());
+
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to wait for events");
+  }
 }
 
-cl_int cl::event::impl::event_status(void) const
+bool cl::event::completed(void) const
 {
   cl_int stat = 0;
   cl_int cl_err = clGetEventInfo(ev, CL_EVENT_COMMAND_EXECUTION_STATUS,
@@ -60,67 +109,185 @@ cl_int cl::event::impl::event_status(void) const
     throw cl::error("unable to determine event execution status");
   }
 
-  return stat;
+  return stat == CL_COMPLETE;
+}
+
+cl::event::profile_info cl::event::profile(void) const
+{
+  const cl_profiling_info names[4] = {
+    CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT,
+    CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END
+  };
+  cl_ulong stamps[4];
+
+  for(unsigned i = 0; i < 4; ++i) {
+    cl_int cl_err = clGetEventProfilingInfo(ev, names[i], sizeof(stamps[i]),
+        &stamps[i], NULL);
+    if(cl_err != CL_SUCCESS) {
+      throw cl::error("unable to obtain event profiling info");
+    }
+  }
+
+  profile_info info;
+  info.queued = stamps[0];
+  info.submit = stamps[1];
+  info.start = stamps[2];
+  info.end = stamps[3];
+
+  return info;
 }
 
-cl::event::event(const impl &i)
-  : pimpl(new impl(i))
+void cl::event::then(const callback &f) const
 {
+  std::auto_ptr<callback> data(new callback(f));
+
+  cl_int cl_err = clSetEventCallback(ev, CL_COMPLETE, run_callback,
+      data.get());
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to set event callback");
+  }
+  data.release();
 }
 
-cl::event::event(const event &e)
-  : pimpl(new impl(*e.pimpl))
+std::future<void> cl::event::future(void) const
 {
+  std::shared_ptr<std::promise<void> > done =
+    std::make_shared<std::promise<void> >();
+  std::future<void> ret = done->get_future();
+
+  then([done](bool success) {
+      if(success) {
+        done->set_value();
+      } else {
+        done->set_exception(std::make_exception_ptr(
+              cl::error("command terminated abnormally")));
+      }
+    });
+
+  return ret;
 }
 
-cl::event &cl::event::operator=(const event &e)
+void cl::event::swap(event &e)
 {
-  *pimpl = *e.pimpl;
+  std::swap(ev, e.ev);
+}
 
-  return *this;
+cl::wait_list::wait_list(void)
+  : inline_evs()
+  , overflow()
+  , count(0)
+{
 }
 
-cl::event::~event(void)
+cl::wait_list::wait_list(const event &e)
+  : inline_evs()
+  , overflow()
+  , count(0)
 {
+  push_back(e);
 }
 
-void cl::event::wait(void) const
+cl::wait_list::wait_list(const std::vector<event> &evs)
+  : inline_evs()
+  , overflow()
+  , count(0)
 {
-  const cl_event ev = pimpl->get_event();
+  for(std::vector<event>::const_iterator e = evs.begin(); e != evs.end();
+      ++e) {
+    push_back(*e);
+  }
+}
 
-  cl_int cl_err = clWaitForEvents(1, &ev);
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to wait on event");
+cl::wait_list::wait_list(const wait_list &wl)
+  : inline_evs()
+  , overflow()
+  , count(0)
+{
+  _cl_event *const *evs = wl.data();
+  for(std::size_t i = 0; i < wl.size(); ++i) {
+    retain(evs[i]);
+    if(count < inline_capacity) {
+      inline_evs[count] = evs[i];
+    }
+    ++count;
+  }
+  if(count > inline_capacity) {
+    overflow.assign(evs, evs + count);
   }
 }
 
-void cl::event::wait_all(const std::vector<event> &evs)
+cl::wait_list &cl::wait_list::operator=(const wait_list &wl)
 {
-  const std::vector<cl_event> events = impl::get_events(evs);
+  wait_list newwl(wl);
 
-  int cl_err = clWaitForEvents(events.size(), &events[0]);
+  swap(newwl);
 
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to wait for events");
+  return *this;
+}
+
+cl::wait_list::~wait_list(void)
+{
+  clear();
+}
+
+void cl::wait_list::push_back(const event &e)
+{
+  retain(e.ev);
+  if(count < inline_capacity) {
+    inline_evs[count] = e.ev;
+  } else {
+    if(count == inline_capacity) {
+      overflow.assign(inline_evs, inline_evs + inline_capacity);
+    }
+    overflow.push_back(e.ev);
   }
+  ++count;
 }
 
-bool cl::event::completed(void) const
+void cl::wait_list::clear(void)
 {
-  return pimpl->event_status() == CL_COMPLETE;
+  _cl_event *const *evs = data();
+  for(std::size_t i = 0; i < count; ++i) {
+    release(evs[i], "cl::wait_list::clear");
+  }
+  overflow.clear();
+  count = 0;
 }
 
-std::vector<cl_event>
-cl::event::impl::get_events(const std::vector<event> &evs)
+std::size_t cl::wait_list::size(void) const
 {
-  std::vector<cl_event> ret;
-  ret.reserve(evs.size());
+  return count;
+}
 
-  for(std::vector<event>::const_iterator ev = evs.begin();
-      ev != evs.end(); ++ev)
-  {
-    ret.push_back(ev->pimpl->get_event());
+bool cl::wait_list::empty(void) const
+{
+  return count == 0;
+}
+
+_cl_event *const *cl::wait_list::data(void) const
+{
+  if(count == 0) {
+    return NULL;
   }
 
-  return ret;
+  return count > inline_capacity ? &overflow[0] : inline_evs;
+}
+
+void cl::wait_list::swap(wait_list &wl)
+{
+  std::swap(inline_evs, wl.inline_evs);
+  std::swap(overflow, wl.overflow);
+  std::swap(count, wl.count);
+}
+
+template<>
+void std::swap(cl::event &a, cl::event &b)
+{
+  a.swap(b);
+}
+
+template<>
+void std::swap(cl::wait_list &a, cl::wait_list &b)
+{
+  a.swap(b);
 }
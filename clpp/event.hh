@@ -1,34 +1,171 @@
 #ifndef CLPP_CL_EVENT_HH_INCLUDED
 #define CLPP_CL_EVENT_HH_INCLUDED
 
-#include <memory>
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <future>
 #include <vector>
+#include "error.hh"
+
+/* Coroutine support where the compiler implements C++20 coroutines */
+#ifdef __has_include
+#  if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#    include <coroutine>
+#  endif
+#endif
+
+/* The OpenCL event type, cl_event is a pointer to it */
+struct _cl_event;
 
 namespace cl {
   class queue;
+  class wait_list;
 
+  //! Completion of an enqueued command
+  /*! Holds the OpenCL event directly rather than through an impl, so events
+   *  returned by queue::add cost no allocation. Copies share the event, the
+   *  last one to go releases it. A moved from event is empty.
+   */
   class event {
     private:
-    class impl;
-    std::auto_ptr<impl> pimpl;
+    _cl_event *ev;
 
-    explicit event(const impl &i);
+    explicit event(_cl_event *e);
     public:
     event(const event &e);
+    event(event &&e);
     event &operator=(const event &e);
+    event &operator=(event &&e);
     ~event(void);
 
     //! Wait for this event to complete
     void wait(void) const;
 
     //! Wait for all events to complete
-    static void wait_all(const std::vector<event> &evs);
+    static void wait_all(const wait_list &evs);
 
     //! Check to see if this event has completed
     bool completed(void) const;
 
+    //! Device timestamps of a command, in nanoseconds
+    struct profile_info {
+      unsigned long long queued, submit, start, end;
+    };
+
+    //! Obtain the timestamps of the command of this event
+    /*! Needs a queue created with profiling enabled and a completed command.
+     */
+    profile_info profile(void) const;
+
+    //! Called once with whether the command completed successfully
+    typedef std::function<void(bool)> callback;
+
+    //! Run f once the command has finished
+    /*! f runs on a thread of the OpenCL implementation, possibly before then
+     *  returns, so it should be short and must not block on other commands.
+     *  Exceptions thrown by f are reported and dropped.
+     */
+    void then(const callback &f) const;
+
+    //! A future which becomes ready once the command has finished
+    /*! Its get() throws cl::error if the command was terminated. */
+    std::future<void> future(void) const;
+
+
+    void swap(event &e);
+
     friend class queue;
+    friend class wait_list;
+    friend class command_list;
+    friend class buffer_map;
+    friend class profiler;
   };
+
+  //! Events a command has to wait for
+  /*! Keeps the first few events inline, so the short lists of the enqueue
+   *  path never allocate. Converts implicitly from a single event and from a
+   *  vector of events.
+   */
+  class wait_list {
+    private:
+    static const std::size_t inline_capacity = 4;
+    _cl_event *inline_evs[inline_capacity];
+    /* All events once there are more than fit inline */
+    std::vector<_cl_event *> overflow;
+    std::size_t count;
+
+    public:
+    wait_list(void);
+    wait_list(const event &e);
+    wait_list(const std::vector<event> &evs);
+    wait_list(const wait_list &wl);
+    wait_list &operator=(const wait_list &wl);
+    ~wait_list(void);
+
+    //! Add e to the list
+    void push_back(const event &e);
+    //! Drop all events
+    void clear(void);
+
+    std::size_t size(void) const;
+    bool empty(void) const;
+
+    //! The events, contiguous, or null for an empty list
+    _cl_event *const *data(void) const;
+
+    void swap(wait_list &wl);
+  };
+
+#ifdef __cpp_lib_coroutine
+  //! Suspends a coroutine until the command of an event has finished
+  /*! The coroutine is resumed on the callback thread of event::then(). */
+  class event_awaiter {
+    private:
+    event ev;
+    bool ok;
+
+    public:
+    explicit event_awaiter(const event &e)
+      : ev(e), ok(true)
+    {
+    }
+
+    bool await_ready(void) const
+    {
+      return ev.completed();
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+      /* The coroutine, and this awaiter with it, may be gone as soon as the
+       * callback has run, so nothing is touched after then().
+       */
+      ev.then([this, h](bool success) {
+          ok = success;
+          h.resume();
+        });
+    }
+
+    void await_resume(void) const
+    {
+      if(!ok) {
+        throw cl::error("awaited command terminated abnormally");
+      }
+    }
+  };
+
+  //! co_await on an event resumes once its command has finished
+  inline event_awaiter operator co_await(const event &e)
+  {
+    return event_awaiter(e);
+  }
+#endif
+};
+
+namespace std {
+  template<> void swap(cl::event &a, cl::event &b);
+  template<> void swap(cl::wait_list &a, cl::wait_list &b);
 };
 
 #endif /* CLPP_CL_EVENT_HH_INCLUDED */
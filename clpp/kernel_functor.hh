@@ -0,0 +1,115 @@
+#ifndef CLPP_CL_KERNEL_FUNCTOR_HH_INCLUDED
+#define CLPP_CL_KERNEL_FUNCTOR_HH_INCLUDED
+
+#include <type_traits>
+#include <vector>
+#include "buffer.hh"
+#include "error.hh"
+#include "event.hh"
+#include "program.hh"
+#include "queue.hh"
+
+namespace cl {
+  namespace detail {
+    /* Binds buffers and images by handle, local_space as a local memory size
+     * and anything else by value.
+     */
+    template<typename T, bool is_mem = std::is_base_of<mem, T>::value>
+    struct arg_binder {
+      static_assert(std::is_pod<T>::value,
+          "kernel arguments passed by value have to be POD");
+
+      static void bind(kernel &k, unsigned int n, const T &value)
+      {
+        k.set_arg(n, sizeof(T), &value);
+      }
+    };
+
+    template<typename T>
+    struct arg_binder<T, true> {
+      static void bind(kernel &k, unsigned int n, const T &m)
+      {
+        k.set_arg(n, m);
+      }
+    };
+
+    template<>
+    struct arg_binder<local_space, false> {
+      static void bind(kernel &k, unsigned int n, const local_space &ls)
+      {
+        k.set_arg(n, ls.size(), 0);
+      }
+    };
+  }
+
+  //! A kernel with typed arguments together with the range it runs over
+  /*! Args are the kernel arguments in order: buffers, local_space, or scalars
+   *  and structs like params_t which are passed by value, so they need no
+   *  buffer of their own. The argument count is checked once on construction;
+   *  binding and enqueueing then go straight to the OpenCL calls.
+   */
+  template<typename... Args>
+  class kernel_functor {
+    private:
+    kernel k;
+    nd_run range;
+
+    template<unsigned int N>
+    void bind_from(void)
+    {
+    }
+
+    template<unsigned int N, typename T, typename... Rest>
+    void bind_from(const T &value, const Rest &... rest)
+    {
+      detail::arg_binder<T>::bind(k, N, value);
+      bind_from<N + 1>(rest...);
+    }
+
+    public:
+    //! Wrap kern to run over a range of work_dim dimensions
+    /*! local_dims may be null to let the implementation choose. */
+    kernel_functor(const kernel &kern, unsigned work_dim,
+        const std::size_t *global_dims, const std::size_t *local_dims = 0)
+      : k(kern)
+      , range(kern, work_dim, global_dims, local_dims)
+    {
+      if(k.argc() != sizeof...(Args)) {
+        throw cl::error("kernel argument count does not match functor");
+      }
+    }
+
+    //! Bind all arguments, they stay bound for later enqueues
+    kernel_functor &bind(const Args &... args)
+    {
+      bind_from<0>(args...);
+
+      return *this;
+    }
+
+    //! Enqueue with the arguments bound last
+    event operator()(queue &q,
+        const wait_list &waitlist = wait_list()) const
+    {
+      return q.add(range, waitlist);
+    }
+
+    //! Enqueue with the arguments bound last, without an event
+    void operator()(queue &q, no_event_t,
+        const wait_list &waitlist = wait_list()) const
+    {
+      q.add(range, no_event, waitlist);
+    }
+
+    //! Bind args and enqueue
+    event operator()(queue &q, const wait_list &waitlist,
+        const Args &... args)
+    {
+      bind(args...);
+
+      return q.add(range, waitlist);
+    }
+  };
+}
+
+#endif /* CLPP_CL_KERNEL_FUNCTOR_HH_INCLUDED */
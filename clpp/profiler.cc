@@ -0,0 +1,187 @@
+#include <algorithm>
+#include <iomanip>
+
+#include <CL/cl.h>
+
+#include "profiler.hh"
+#include "program_internal.hh"
+
+namespace {
+  /* Outstanding events kept before the completed ones are first folded in.
+   * Each fold doubles what is left over, so a deep queue of commands which
+   * have not run yet costs amortized constant time per record.
+   */
+  const std::size_t pending_limit = 1024;
+
+  const double ns = 1e-9;
+}
+
+cl::profiler::profiler(void)
+  : table()
+  , spans()
+  , pending()
+  , fold_at(pending_limit)
+  , kernel_names()
+{
+}
+
+/* copy constructor cl::profiler::profiler(const profiler &)
+ * intentionally not defined
+ */
+
+cl::profiler::~profiler(void)
+{
+}
+
+/* assignment operator cl::profiler::operator=(const profiler &)
+ * intentionally not defined
+ */
+
+void cl::profiler::fold(const std::string &name, const event &ev)
+{
+  const event::profile_info info = ev.profile();
+  sample_table::iterator s = table.find(name);
+  if(s == table.end()) {
+    s = table.insert(std::make_pair(name, samples())).first;
+    s->second.latency = 0;
+  }
+  s->second.run.push_back(info.end - info.start);
+  s->second.latency += info.start - info.queued;
+
+  cl_command_queue q;
+  cl_int cl_err = clGetEventInfo(ev.ev, CL_EVENT_COMMAND_QUEUE, sizeof(q), &q,
+      NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to determine queue of profiled event");
+  }
+  spans[q].push_back(std::make_pair(info.start, info.end));
+}
+
+void cl::profiler::fold_completed(void)
+{
+  std::vector<std::pair<std::string, event> > still_pending;
+  for(std::vector<std::pair<std::string, event> >::const_iterator p =
+      pending.begin(); p != pending.end(); ++p) {
+    if(p->second.completed()) {
+      fold(p->first, p->second);
+    } else {
+      still_pending.push_back(*p);
+    }
+  }
+  pending.swap(still_pending);
+  fold_at = std::max(pending_limit, 2*pending.size());
+}
+
+void cl::profiler::record(const std::string &name, const event &ev)
+{
+  if(pending.size() >= fold_at) {
+    fold_completed();
+  }
+  pending.push_back(std::make_pair(name, ev));
+}
+
+void cl::profiler::record(const kernel &k, const event &ev)
+{
+  const void *key = k.pimpl->get_kernel();
+  std::map<const void *, std::string>::iterator n = kernel_names.find(key);
+  if(n == kernel_names.end()) {
+    n = kernel_names.insert(std::make_pair(key, k.name())).first;
+  }
+  record(n->second, ev);
+}
+
+void cl::profiler::reset(void)
+{
+  for(std::vector<std::pair<std::string, event> >::const_iterator p =
+      pending.begin(); p != pending.end(); ++p) {
+    p->second.wait();
+  }
+  pending.clear();
+  fold_at = pending_limit;
+  table.clear();
+  spans.clear();
+}
+
+void cl::profiler::fold_all(void)
+{
+  for(std::vector<std::pair<std::string, event> >::const_iterator p =
+      pending.begin(); p != pending.end(); ++p) {
+    p->second.wait();
+    fold(p->first, p->second);
+  }
+  pending.clear();
+  fold_at = pending_limit;
+}
+
+std::vector<double> cl::profiler::busy_times(void)
+{
+  fold_all();
+
+  std::vector<double> ret;
+  for(std::map<const void *, span_list>::iterator q = spans.begin();
+      q != spans.end(); ++q) {
+    span_list &sl = q->second;
+    std::sort(sl.begin(), sl.end());
+    /* Sum the union of the spans, merging those which overlap */
+    unsigned long long total = 0, start = sl.front().first,
+      end = sl.front().second;
+    for(span_list::const_iterator s = sl.begin(); s != sl.end(); ++s) {
+      if(s->first > end) {
+        total += end - start;
+        start = s->first;
+      }
+      end = std::max(end, s->second);
+    }
+    total += end - start;
+    ret.push_back(total*ns);
+  }
+
+  return ret;
+}
+
+std::vector<cl::profiler::summary> cl::profiler::collect(void)
+{
+  fold_all();
+
+  std::vector<summary> ret;
+  for(sample_table::iterator s = table.begin(); s != table.end(); ++s) {
+    std::vector<unsigned long long> &run = s->second.run;
+    std::sort(run.begin(), run.end());
+
+    summary sum;
+    sum.name = s->first;
+    sum.count = run.size();
+    sum.total = 0;
+    for(std::size_t i = 0; i < run.size(); ++i) {
+      sum.total += run[i]*ns;
+    }
+    sum.min = run.front()*ns;
+    sum.median = run[run.size()/2]*ns;
+    sum.p99 = run[(run.size()*99 + 99)/100 - 1]*ns;
+    sum.latency = s->second.latency*ns;
+    ret.push_back(sum);
+  }
+
+  return ret;
+}
+
+void cl::profiler::report(std::ostream &out)
+{
+  const std::vector<summary> sums = collect();
+  const std::streamsize prec = out.precision();
+
+  out << std::left << std::setw(24) << "command" << std::right <<
+    std::setw(8) << "count" << std::setw(12) << "total" <<
+    std::setw(12) << "min" << std::setw(12) << "median" <<
+    std::setw(12) << "p99" << std::setw(12) << "queued" << std::endl;
+  for(std::vector<summary>::const_iterator s = sums.begin();
+      s != sums.end(); ++s) {
+    out << std::left << std::setw(24) << s->name << std::right <<
+      std::setw(8) << s->count << std::scientific << std::setprecision(3) <<
+      std::setw(12) << s->total << std::setw(12) << s->min <<
+      std::setw(12) << s->median << std::setw(12) << s->p99 <<
+      std::setw(12) << s->latency << std::endl;
+    out.unsetf(std::ios::floatfield);
+  }
+  out.precision(prec);
+}
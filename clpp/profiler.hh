@@ -0,0 +1,82 @@
+#ifndef CLPP_CL_PROFILER_HH_INCLUDED
+#define CLPP_CL_PROFILER_HH_INCLUDED
+
+#include <map>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+#include "event.hh"
+#include "program.hh"
+
+namespace cl {
+  //! Per command name statistics of profiled events
+  /*! A queue with a profiler attached records every command it enqueues,
+   *  kernels under their function name. Events are kept until they have
+   *  completed and are then folded into the statistics, so the queue has to
+   *  be created with profiling enabled.
+   */
+  class profiler {
+    public:
+    //! Statistics of the commands of one name, times in seconds
+    struct summary {
+      std::string name;
+      std::size_t count;
+      //! Execution time, from start to end of the command
+      double total, min, median, p99;
+      //! Summed queueing latency, from enqueue to start of the command
+      double latency;
+    };
+
+    private:
+    struct samples {
+      std::vector<unsigned long long> run;
+      unsigned long long latency;
+    };
+    typedef std::map<std::string, samples> sample_table;
+    sample_table table;
+    /* Start and end of every command, by command queue */
+    typedef std::vector<std::pair<unsigned long long, unsigned long long> >
+      span_list;
+    std::map<const void *, span_list> spans;
+    std::vector<std::pair<std::string, event> > pending;
+    /* Size of pending at which completed events are folded in next */
+    std::size_t fold_at;
+    /* Function names of the kernels seen so far, by kernel object */
+    std::map<const void *, std::string> kernel_names;
+
+    void fold(const std::string &name, const event &ev);
+    void fold_completed(void);
+    void fold_all(void);
+
+    profiler(const profiler &p);
+    profiler &operator=(const profiler &p);
+
+    public:
+    profiler(void);
+    ~profiler(void);
+
+    //! Record the command of ev under name
+    void record(const std::string &name, const event &ev);
+    //! Record a run of kernel k which completes with ev
+    void record(const kernel &k, const event &ev);
+
+    //! Drop all recorded commands and statistics
+    /*! Waits for outstanding commands first. */
+    void reset(void);
+
+    //! Wait for all recorded commands and summarize them by name
+    std::vector<summary> collect(void);
+
+    //! Wait for all recorded commands and sum up how long each queue worked
+    /*! In seconds, one entry per queue. Commands which overlap on a queue
+     *  are counted once, so no entry exceeds the wall time.
+     */
+    std::vector<double> busy_times(void);
+
+    //! Print the summaries of collect() as a table to out
+    void report(std::ostream &out);
+  };
+}
+
+#endif /* CLPP_CL_PROFILER_HH_INCLUDED */
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <vector>
 
 #include "error.hh"
@@ -140,18 +142,44 @@ cl::program &cl::program::operator=(const program &p)
 cl::program cl::program::from_source(const context &c,
     const std::string &filename)
 {
-  /* Read the source in chunks */
-  std::ifstream source(filename.c_str());
-  std::string data;
-  std::vector<char> read_buf(1024);
-  std::size_t read_size;
+  /* Read the whole source at once */
+  std::ifstream source(filename.c_str(), std::ios::in | std::ios::binary);
+  if(!source) {
+    throw cl::error("unable to open program source " + filename);
+  }
+  std::ostringstream data;
+  data << source.rdbuf();
+
+  return from_string(c, data.str());
+}
+
+cl::program cl::program::from_memory(const context &c, const void *data,
+    std::size_t len)
+{
+  return from_string(c,
+      std::string(static_cast<const char *>(data), len));
+}
 
-  while(source.get(&read_buf[0], read_buf.size(),
-        std::ifstream::traits_type::eof())) {
-    // TODO: use a non-O(n^2) algorithm for this
-    data.append(&read_buf[0], source.gcount());
+cl::program cl::program::from_il(const context &c, const void *il,
+    std::size_t len)
+{
+#ifdef CL_VERSION_2_1
+  cl_int cl_err = CL_SUCCESS;
+  cl_program prog = clCreateProgramWithIL(c.pimpl->get_context(), il, len,
+      &cl_err);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("error creating program from IL");
   }
 
+  return program(impl(prog, false));
+#else
+  throw cl::error("IL programs need OpenCL 2.1 headers");
+#endif
+}
+
+cl::program cl::program::from_string(const context &c,
+    const std::string &data)
+{
   /* Create the program */
   const char *data_chunk = data.data();
   std::size_t chunk_len = data.length();
@@ -165,11 +193,78 @@ cl::program cl::program::from_source(const context &c,
   return program(impl(prog, false));
 }
 
-cl::program::build_info cl::program::build(const device &dev) const
+cl::program cl::program::from_binary(const context &c, const device &dev,
+    const std::vector<unsigned char> &bin)
 {
   const cl_device_id did = dev.pimpl->get_device();
-  cl_int cl_err = clBuildProgram(pimpl->get_program(), 1, &did, NULL, NULL,
-      NULL);
+  const std::size_t bin_len = bin.size();
+  const unsigned char *bin_data = bin.empty() ? NULL : &bin[0];
+  cl_int bin_status = CL_SUCCESS;
+  cl_int cl_err = CL_SUCCESS;
+  cl_program prog = clCreateProgramWithBinary(c.pimpl->get_context(), 1, &did,
+      &bin_len, &bin_data, &bin_status, &cl_err);
+  if(cl_err != CL_SUCCESS || bin_status != CL_SUCCESS) {
+    if(cl_err == CL_SUCCESS && clReleaseProgram(prog) != CL_SUCCESS) {
+      std::cerr << "unable to release program with invalid binary" <<
+        std::endl;
+    }
+    throw cl::error("error creating program from binary");
+  }
+
+  return program(impl(prog, false));
+}
+
+std::vector<unsigned char> cl::program::binary(const device &dev) const
+{
+  const cl_program p = pimpl->get_program();
+
+  /* Find the device among those of the program */
+  cl_uint num_devices = 0;
+  cl_int cl_err = clGetProgramInfo(p, CL_PROGRAM_NUM_DEVICES,
+      sizeof(num_devices), &num_devices, NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to determine number of program devices");
+  }
+  std::vector<cl_device_id> dids(num_devices);
+  cl_err = clGetProgramInfo(p, CL_PROGRAM_DEVICES,
+      dids.size()*sizeof(cl_device_id), &dids[0], NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain program devices");
+  }
+  const std::size_t index = std::find(dids.begin(), dids.end(),
+      dev.pimpl->get_device()) - dids.begin();
+  if(index == dids.size()) {
+    throw cl::error("device not associated with program");
+  }
+
+  /* Binaries come back for every device at once */
+  std::vector<std::size_t> sizes(num_devices);
+  cl_err = clGetProgramInfo(p, CL_PROGRAM_BINARY_SIZES,
+      sizes.size()*sizeof(std::size_t), &sizes[0], NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to determine program binary sizes");
+  }
+  std::vector<std::vector<unsigned char> > bins(num_devices);
+  std::vector<unsigned char *> bin_ptrs(num_devices);
+  for(std::size_t i = 0; i < bins.size(); ++i) {
+    bins[i].resize(sizes[i]);
+    bin_ptrs[i] = sizes[i] ? &bins[i][0] : NULL;
+  }
+  cl_err = clGetProgramInfo(p, CL_PROGRAM_BINARIES,
+      bin_ptrs.size()*sizeof(unsigned char *), &bin_ptrs[0], NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain program binaries");
+  }
+
+  return bins[index];
+}
+
+cl::program::build_info cl::program::build(const device &dev,
+    const std::string &options) const
+{
+  const cl_device_id did = dev.pimpl->get_device();
+  cl_int cl_err = clBuildProgram(pimpl->get_program(), 1, &did,
+      options.c_str(), NULL, NULL);
   if(cl_err != CL_SUCCESS && cl_err != CL_BUILD_PROGRAM_FAILURE) {
     throw cl::error("error building program");
   }
@@ -177,6 +272,32 @@ cl::program::build_info cl::program::build(const device &dev) const
   return build_info(*this, dev);
 }
 
+std::vector<cl::program::build_info> cl::program::build(
+    const std::vector<device> &devs, const std::string &options) const
+{
+  std::vector<cl_device_id> dids;
+  dids.reserve(devs.size());
+  for(std::vector<device>::const_iterator d = devs.begin(); d != devs.end();
+      ++d) {
+    dids.push_back(d->pimpl->get_device());
+  }
+
+  cl_int cl_err = clBuildProgram(pimpl->get_program(), dids.size(),
+      dids.empty() ? NULL : &dids[0], options.c_str(), NULL, NULL);
+  if(cl_err != CL_SUCCESS && cl_err != CL_BUILD_PROGRAM_FAILURE) {
+    throw cl::error("error building program");
+  }
+
+  std::vector<build_info> infos;
+  infos.reserve(devs.size());
+  for(std::vector<device>::const_iterator d = devs.begin(); d != devs.end();
+      ++d) {
+    infos.push_back(build_info(*this, *d));
+  }
+
+  return infos;
+}
+
 cl::kernel cl::program::get_kernel(const std::string &name) const
 {
   const char *cname = name.c_str();
@@ -310,6 +431,44 @@ unsigned int cl::kernel::argc(void) const
   return nargs;
 }
 
+std::string cl::kernel::name(void) const
+{
+  const cl_kernel kobj = pimpl->get_kernel();
+  std::size_t len = 0;
+  cl_int cl_err = clGetKernelInfo(kobj, CL_KERNEL_FUNCTION_NAME, 0, NULL,
+      &len);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to determine kernel name length");
+  }
+  std::vector<char> kname(len + 1);
+  cl_err = clGetKernelInfo(kobj, CL_KERNEL_FUNCTION_NAME, len, &kname[0],
+      NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain kernel name");
+  }
+
+  return std::string(&kname[0]);
+}
+
+void cl::kernel::set_arg(unsigned int n, std::size_t size,
+    const void *value)
+{
+  const cl_kernel kobj = pimpl->get_kernel();
+
+  cl_int cl_err = clSetKernelArg(kobj, n, size, value);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error(value ? "unable to bind kernel argument" :
+        "unable to bind local memory");
+  }
+}
+
+void cl::kernel::set_arg(unsigned int n, const mem &m)
+{
+  const cl_mem memobj = m.pimpl->get_mem();
+
+  set_arg(n, sizeof(cl_mem), &memobj);
+}
+
 void cl::kernel::swap(kernel &k)
 {
   std::swap(pimpl, k.pimpl);
@@ -337,23 +496,12 @@ cl::kernel::arg_proxy::~arg_proxy(void)
 
 void cl::kernel::arg_proxy::operator<<=(const mem &m)
 {
-  const cl_mem memobj = m.pimpl->get_mem();
-  const cl_kernel kobj = kern.pimpl->get_kernel();
-
-  cl_int cl_err = clSetKernelArg(kobj, argnum, sizeof(cl_mem), &memobj);
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to bind kernel argument");
-  }
+  kern.set_arg(argnum, m);
 }
 
 void cl::kernel::arg_proxy::operator<<=(const local_space &ls)
 {
-  const cl_kernel kobj = kern.pimpl->get_kernel();
-
-  cl_int cl_err = clSetKernelArg(kobj, argnum, ls.size(), NULL);
-  if(cl_err != CL_SUCCESS) {
-    throw cl::error("unable to bind local memory");
-  }
+  kern.set_arg(argnum, ls.size(), NULL);
 }
 
 template<>
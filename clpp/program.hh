@@ -4,6 +4,7 @@
 #include <algorithm>
 #include <memory>
 #include <string>
+#include <vector>
 #include "buffer.hh"
 #include "context.hh"
 #include "device.hh"
@@ -26,11 +27,21 @@ namespace cl {
     class arg_proxy;
     std::vector<arg_proxy> argv(void);
     unsigned int argc(void) const;
+    //! Obtain the name of the kernel function
+    std::string name(void) const;
+
+    //! Bind size bytes at value to argument n
+    /*! A null value reserves size bytes of local memory instead. */
+    void set_arg(unsigned int n, std::size_t size, const void *value);
+    //! Bind a buffer or image to argument n
+    void set_arg(unsigned int n, const mem &m);
 
     void swap(kernel &k);
 
     friend class program;
     friend class queue;
+    friend class profiler;
+    friend class command_list;
   };
 
   class kernel::arg_proxy {
@@ -69,15 +80,41 @@ namespace cl {
     //! Create a new program object from source code in a file.
     static program from_source(const context &c,
         const std::string &filename);
+    //! Create a new program object from source code in a string.
+    static program from_string(const context &c, const std::string &source);
+    //! Create a new program object from len bytes of source code at data.
+    static program from_memory(const context &c, const void *data,
+        std::size_t len);
+    //! Create a new program object from an intermediate language module.
+    /*! Typically SPIR-V, needs an OpenCL 2.1 platform and a device listing
+     *  the IL in device::il_version().
+     */
+    static program from_il(const context &c, const void *il, std::size_t len);
+    //! Create a new program object for dev from a binary.
+    /*! The binary is one previously obtained through binary(); the program
+     *  still has to be built.
+     */
+    static program from_binary(const context &c, const device &dev,
+        const std::vector<unsigned char> &bin);
+
+    //! Obtain the binary the program was built into for dev
+    std::vector<unsigned char> binary(const device &dev) const;
 
     class build_info;
     //! Build a program for a particular device
-    build_info build(const device &dev) const;
+    /*! options are passed on to the compiler, e.g. -D definitions. */
+    build_info build(const device &dev,
+        const std::string &options = std::string()) const;
+    //! Build a program for several devices of its context at once
+    /*! Returns the build info of each device, in the order of devs. */
+    std::vector<build_info> build(const std::vector<device> &devs,
+        const std::string &options = std::string()) const;
 
     //! Obtain a kernel from this program
     kernel get_kernel(const std::string &name) const;
 
     friend class build_info;
+    friend class program_cache;
   };
 
   class program::build_info {
@@ -0,0 +1,175 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "error.hh"
+#include "program_cache.hh"
+#include "program_internal.hh"
+
+namespace {
+  /* 64 bit FNV-1a, continuing from hash */
+  unsigned long long fnv1a(const std::string &s,
+      unsigned long long hash = 14695981039346656037ULL)
+  {
+    for(std::string::const_iterator c = s.begin(); c != s.end(); ++c) {
+      hash ^= static_cast<unsigned char>(*c);
+      hash *= 1099511628211ULL;
+    }
+
+    return hash;
+  }
+
+  std::string read_file(const std::string &filename)
+  {
+    std::ifstream in(filename.c_str(), std::ios::in | std::ios::binary);
+    if(!in) {
+      throw cl::error("unable to read " + filename);
+    }
+    std::ostringstream data;
+    data << in.rdbuf();
+
+    return data.str();
+  }
+
+  /* Create dir and its parents, failures show up when writing */
+  void make_directories(const std::string &dir)
+  {
+    for(std::string::size_type slash = dir.find('/', 1);
+        slash != std::string::npos; slash = dir.find('/', slash + 1)) {
+      mkdir(dir.substr(0, slash).c_str(), 0755);
+    }
+    mkdir(dir.c_str(), 0755);
+  }
+
+  bool load_binary(const std::string &path, std::vector<unsigned char> &bin)
+  {
+    std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+    if(!in) {
+      return false;
+    }
+    bin.assign(std::istreambuf_iterator<char>(in),
+        std::istreambuf_iterator<char>());
+
+    return !bin.empty();
+  }
+
+  /* Write to a temporary first so concurrent runs never see half a file */
+  void store_binary(const std::string &path,
+      const std::vector<unsigned char> &bin)
+  {
+    if(bin.empty()) {
+      return;
+    }
+    std::ostringstream tmp;
+    tmp << path << '.' << getpid();
+    {
+      std::ofstream out(tmp.str().c_str(),
+          std::ios::out | std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char *>(&bin[0]), bin.size());
+      if(!out) {
+        out.close();
+        std::remove(tmp.str().c_str());
+        return;
+      }
+    }
+    if(std::rename(tmp.str().c_str(), path.c_str()) != 0) {
+      std::remove(tmp.str().c_str());
+    }
+  }
+}
+
+cl::program_cache::program_cache(const std::string &directory)
+  : dir(directory)
+  , kernels()
+{
+}
+
+/* copy constructor cl::program_cache::program_cache(const program_cache &)
+ * intentionally not defined
+ */
+
+cl::program_cache::~program_cache(void)
+{
+}
+
+/* assignment operator cl::program_cache::operator=(const program_cache &)
+ * intentionally not defined
+ */
+
+std::string cl::program_cache::default_directory(void)
+{
+  const char *env_dir = std::getenv("CLPP_CACHE_DIR");
+  if(env_dir && *env_dir) {
+    return env_dir;
+  }
+  const char *home = std::getenv("HOME");
+
+  return std::string(home && *home ? home : ".") + "/.cache/clpp";
+}
+
+cl::program cl::program_cache::build(const context &c, const device &dev,
+    const std::string &filename, const std::string &options, bool *hit)
+{
+  return build_source(c, dev, read_file(filename), options, hit);
+}
+
+cl::program cl::program_cache::build_source(const context &c,
+    const device &dev, const std::string &source, const std::string &options,
+    bool *hit)
+{
+  /* Separate the fields so that moving text between them changes the key */
+  unsigned long long key = fnv1a(source);
+  key = fnv1a(std::string(1, '\0') + options, key);
+  key = fnv1a(std::string(1, '\0') + dev.name(), key);
+  key = fnv1a(std::string(1, '\0') + dev.driver_version(), key);
+  std::ostringstream path;
+  path << dir << '/' << std::hex << std::setw(16) << std::setfill('0') <<
+    key << ".bin";
+
+  std::vector<unsigned char> bin;
+  if(load_binary(path.str(), bin)) {
+    try {
+      program prog = program::from_binary(c, dev, bin);
+      if(!!prog.build(dev, options)) {
+        if(hit) {
+          *hit = true;
+        }
+        return prog;
+      }
+    } catch(cl::error &) {
+      /* A stale or foreign binary, fall back to the source */
+    }
+  }
+
+  if(hit) {
+    *hit = false;
+  }
+  program prog = program::from_string(c, source);
+  if(!!prog.build(dev, options)) {
+    make_directories(dir);
+    store_binary(path.str(), prog.binary(dev));
+  }
+
+  return prog;
+}
+
+cl::kernel cl::program_cache::get_kernel(const program &p,
+    const std::string &name, unsigned instance)
+{
+  const kernel_table::key_type key(p.pimpl->get_program(),
+      kernel_name(name, instance));
+  kernel_table::iterator k = kernels.find(key);
+  if(k == kernels.end()) {
+    k = kernels.insert(std::make_pair(key, p.get_kernel(name))).first;
+  }
+
+  return k->second;
+}
@@ -0,0 +1,60 @@
+#ifndef CLPP_CL_PROGRAM_CACHE_HH_INCLUDED
+#define CLPP_CL_PROGRAM_CACHE_HH_INCLUDED
+
+#include <map>
+#include <string>
+#include "context.hh"
+#include "device.hh"
+#include "program.hh"
+
+namespace cl {
+  //! Cache of built programs and their kernels
+  /*! Program binaries are kept on disk, named after a hash of the source, the
+   *  build options, the device name and the driver version, so a later run
+   *  can skip the compiler. Kernels are kept for the lifetime of the cache.
+   */
+  class program_cache {
+    private:
+    std::string dir;
+    /* Kernels by program, name and instance */
+    typedef std::pair<std::string, unsigned> kernel_name;
+    typedef std::map<std::pair<const void *, kernel_name>, kernel>
+      kernel_table;
+    kernel_table kernels;
+
+    program_cache(const program_cache &pc);
+    program_cache &operator=(const program_cache &pc);
+
+    public:
+    //! Setup to keep binaries in directory, created on demand
+    explicit program_cache(const std::string &directory = default_directory());
+    ~program_cache(void);
+
+    //! Directory used when none is given
+    /*! $CLPP_CACHE_DIR if set, $HOME/.cache/clpp otherwise. */
+    static std::string default_directory(void);
+
+    //! Obtain the program in filename built for dev with options
+    /*! The stored binary is used if there is one, otherwise the source is
+     *  built and its binary stored when the build succeeds. The build status
+     *  and log are available through program::build_info as usual. hit, if
+     *  given, is set to whether the binary came from the cache.
+     */
+    program build(const context &c, const device &dev,
+        const std::string &filename, const std::string &options = std::string(),
+        bool *hit = 0);
+    //! As build, but with the source code given in source
+    program build_source(const context &c, const device &dev,
+        const std::string &source, const std::string &options = std::string(),
+        bool *hit = 0);
+
+    //! Obtain a kernel of p, creating it the first time it is asked for
+    /*! Kernels keep their arguments, so users needing several differently
+     *  bound kernels of the same name ask for distinct instances.
+     */
+    kernel get_kernel(const program &p, const std::string &name,
+        unsigned instance = 0);
+  };
+}
+
+#endif /* CLPP_CL_PROGRAM_CACHE_HH_INCLUDED */
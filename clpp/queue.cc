@@ -7,9 +7,11 @@
 #include "queue_internal.hh"
 #include "program_internal.hh"
 #include "buffer_internal.hh"
+#include "profiler.hh"
 
 cl::queue::impl::impl(const cl_command_queue q, bool retain)
   : command_queue(q)
+  , prof(0)
 {
   if(retain) {
     cl_int cl_err = clRetainCommandQueue(command_queue);
@@ -21,6 +23,7 @@ cl::queue::impl::impl(const cl_command_queue q, bool retain)
 
 cl::queue::impl::impl(const impl &i)
   : command_queue(i.command_queue)
+  , prof(i.prof)
 {
   cl_int cl_err = clRetainCommandQueue(command_queue);
   if(cl_err != CL_SUCCESS) {
@@ -55,6 +58,7 @@ cl::queue::impl &cl::queue::impl::operator=(const impl &i)
   }
 
   command_queue = i.command_queue;
+  prof = i.prof;
 
   return *this;
 }
@@ -64,6 +68,16 @@ cl_command_queue cl::queue::impl::get_command_queue(void) const
   return command_queue;
 }
 
+cl::profiler *cl::queue::impl::get_profiler(void) const
+{
+  return prof;
+}
+
+void cl::queue::impl::set_profiler(profiler *p)
+{
+  prof = p;
+}
+
 cl::queue::queue(const impl &i)
   : pimpl(new impl(i))
 {
@@ -85,13 +99,20 @@ cl::queue &cl::queue::operator=(const queue &q)
   return *this;
 }
 
-cl::queue cl::queue::create(const context &c, const device &d)
+cl::queue cl::queue::create(const context &c, const device &d,
+    unsigned int props)
 {
   cl_int cl_err = CL_SUCCESS;
   const cl_device_id dev = d.pimpl->get_device();
   const cl_context ctx = c.pimpl->get_context();
-  cl_command_queue q = clCreateCommandQueue(ctx, dev,
-      CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &cl_err);
+  cl_command_queue_properties cl_props = 0;
+  if(props & QUEUE_OUT_OF_ORDER) {
+    cl_props |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+  }
+  if(props & QUEUE_PROFILING) {
+    cl_props |= CL_QUEUE_PROFILING_ENABLE;
+  }
+  cl_command_queue q = clCreateCommandQueue(ctx, dev, cl_props, &cl_err);
   if(cl_err != CL_SUCCESS) {
     throw cl::error("unable to create command queue");
   }
@@ -99,55 +120,563 @@ cl::queue cl::queue::create(const context &c, const device &d)
   return queue(impl(q, false));
 }
 
-cl::event cl::queue::add(const nd_run &nd, const std::vector<event> &waitlist)
+std::vector<cl::queue> cl::queue::create_all(const context &c,
+    unsigned int props)
 {
-  std::vector<cl_event> waitevs = event::impl::get_events(waitlist);
+  const std::vector<device> devs = c.devices();
+  std::vector<queue> queues;
+  queues.reserve(devs.size());
+  for(std::vector<device>::const_iterator d = devs.begin(); d != devs.end();
+      ++d) {
+    queues.push_back(create(c, *d, props));
+  }
 
-  cl_event ev;
-  int cl_err = CL_SUCCESS;
-  cl_err = clEnqueueNDRangeKernel(
+  return queues;
+}
+
+cl::device cl::queue::get_device(void) const
+{
+  cl_device_id did;
+  cl_int cl_err = clGetCommandQueueInfo(pimpl->get_command_queue(),
+      CL_QUEUE_DEVICE, sizeof(did), &did, NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain command queue device");
+  }
+
+  return device(device::impl(did));
+}
+
+unsigned int cl::queue::properties(void) const
+{
+  cl_command_queue_properties cl_props = 0;
+  cl_int cl_err = clGetCommandQueueInfo(pimpl->get_command_queue(),
+      CL_QUEUE_PROPERTIES, sizeof(cl_props), &cl_props, NULL);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to obtain command queue properties");
+  }
+
+  unsigned int props = QUEUE_IN_ORDER;
+  if(cl_props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
+    props |= QUEUE_OUT_OF_ORDER;
+  }
+  if(cl_props & CL_QUEUE_PROFILING_ENABLE) {
+    props |= QUEUE_PROFILING;
+  }
+
+  return props;
+}
+
+void cl::queue::set_profiler(profiler *p)
+{
+  pimpl->set_profiler(p);
+}
+
+cl::profiler *cl::queue::get_profiler(void) const
+{
+  return pimpl->get_profiler();
+}
+
+void cl::queue::enqueue(const nd_run &nd, const wait_list &waitlist,
+    _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueNDRangeKernel(
       pimpl->get_command_queue(), // Get the command queue primitive
       nd.k.pimpl->get_kernel(), // Get the kernel primitive
       nd.wd, // workspace dimension
       NULL, // always null in OpenCL 1.0
       &nd.gd[0], // global dimensions
       nd.ld.size() ? &nd.ld[0] : NULL, // local dimensions, null if not spec'd
-      waitevs.size(), waitevs.size() ? &waitevs[0] : NULL,
-      &ev);
+      waitlist.size(), waitlist.data(),
+      ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue kernel");
+  }
+}
 
-  return event(event::impl(ev, false));
+void cl::queue::enqueue(const buffer_read &br, const wait_list &waitlist,
+    bool blocking, _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueReadBuffer(pimpl->get_command_queue(),
+      br.buf.pimpl->get_mem(), blocking ? CL_TRUE : CL_FALSE,
+      br.offsetbytes, br.bytes, br.dst, waitlist.size(),
+      waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer read");
+  }
 }
 
-cl::event cl::queue::add(const buffer_read &br,
-    const std::vector<event> &waitlist, bool blocking)
+void cl::queue::enqueue(const buffer_write &bw, const wait_list &waitlist,
+    bool blocking, _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueWriteBuffer(pimpl->get_command_queue(),
+      bw.buf.pimpl->get_mem(), blocking ? CL_TRUE : CL_FALSE,
+      bw.offsetbytes, bw.bytes, bw.src, waitlist.size(),
+      waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer write");
+  }
+}
+
+void cl::queue::enqueue(const buffer_copy &bc, const wait_list &waitlist,
+    _cl_event **ev)
 {
-  std::vector<cl_event> waitevs = event::impl::get_events(waitlist);
+  cl_int cl_err = clEnqueueCopyBuffer(pimpl->get_command_queue(),
+      bc.src.pimpl->get_mem(), bc.dst.pimpl->get_mem(), bc.src_offsetbytes,
+      bc.dst_offsetbytes, bc.bytes, waitlist.size(), waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer copy");
+  }
+}
 
-  cl_event ev;
-  int cl_err = CL_SUCCESS;
+void cl::queue::enqueue(const buffer_fill &bf, const wait_list &waitlist,
+    _cl_event **ev)
+{
+#ifdef CL_VERSION_1_2
+  cl_int cl_err = clEnqueueFillBuffer(pimpl->get_command_queue(),
+      bf.buf.pimpl->get_mem(), &bf.pattern[0], bf.pattern.size(),
+      bf.offsetbytes, bf.bytes, waitlist.size(), waitlist.data(), ev);
+#else
+  /* Write the repeated pattern instead, blocking as the copy is local */
+  std::vector<unsigned char> data(bf.bytes);
+  for(std::size_t i = 0; i < data.size(); ++i) {
+    data[i] = bf.pattern[i % bf.pattern.size()];
+  }
+  cl_int cl_err = clEnqueueWriteBuffer(pimpl->get_command_queue(),
+      bf.buf.pimpl->get_mem(), CL_TRUE, bf.offsetbytes, bf.bytes, &data[0],
+      waitlist.size(), waitlist.data(), ev);
+#endif
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer fill");
+  }
+}
 
-  cl_err = clEnqueueReadBuffer(pimpl->get_command_queue(),
+void cl::queue::enqueue(const buffer_read_rect &br,
+    const wait_list &waitlist, bool blocking, _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueReadBufferRect(pimpl->get_command_queue(),
       br.buf.pimpl->get_mem(), blocking ? CL_TRUE : CL_FALSE,
-      br.offsetbytes, br.bytes, br.dst, waitevs.size(),
-      waitevs.size() ? &waitevs[0] : NULL, &ev);
+      br.buf_origin.offset, br.dst_origin.offset, br.region.size,
+      br.buf_origin.row_pitch, br.buf_origin.slice_pitch,
+      br.dst_origin.row_pitch, br.dst_origin.slice_pitch, br.dst,
+      waitlist.size(), waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue rectangular buffer read");
+  }
+}
+
+void cl::queue::enqueue(const buffer_write_rect &bw,
+    const wait_list &waitlist, bool blocking, _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueWriteBufferRect(pimpl->get_command_queue(),
+      bw.buf.pimpl->get_mem(), blocking ? CL_TRUE : CL_FALSE,
+      bw.buf_origin.offset, bw.src_origin.offset, bw.region.size,
+      bw.buf_origin.row_pitch, bw.buf_origin.slice_pitch,
+      bw.src_origin.row_pitch, bw.src_origin.slice_pitch, bw.src,
+      waitlist.size(), waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue rectangular buffer write");
+  }
+}
+
+void cl::queue::enqueue(const buffer_copy_rect &bc,
+    const wait_list &waitlist, _cl_event **ev)
+{
+  cl_int cl_err = clEnqueueCopyBufferRect(pimpl->get_command_queue(),
+      bc.src.pimpl->get_mem(), bc.dst.pimpl->get_mem(),
+      bc.src_origin.offset, bc.dst_origin.offset, bc.region.size,
+      bc.src_origin.row_pitch, bc.src_origin.slice_pitch,
+      bc.dst_origin.row_pitch, bc.dst_origin.slice_pitch,
+      waitlist.size(), waitlist.data(), ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue rectangular buffer copy");
+  }
+}
+
+cl::event cl::queue::add(const nd_run &nd, const wait_list &waitlist)
+{
+  cl_event ev;
+  enqueue(nd, waitlist, &ev);
 
-  return event(event::impl(ev, false));
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record(nd.k, ret);
+  }
+
+  return ret;
+}
+
+cl::event cl::queue::add(const buffer_read &br,
+    const wait_list &waitlist, bool blocking)
+{
+  cl_event ev;
+  enqueue(br, waitlist, blocking, &ev);
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_read", ret);
+  }
+
+  return ret;
 }
 
 cl::event cl::queue::add(const buffer_write &bw,
-    const std::vector<event> &waitlist, bool blocking)
+    const wait_list &waitlist, bool blocking)
 {
-  std::vector<cl_event> waitevs = event::impl::get_events(waitlist);
+  cl_event ev;
+  enqueue(bw, waitlist, blocking, &ev);
 
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_write", ret);
+  }
+
+  return ret;
+}
+
+void cl::queue::add(const nd_run &nd, no_event_t, const wait_list &waitlist)
+{
+  if(pimpl->get_profiler()) {
+    add(nd, waitlist);
+  } else {
+    enqueue(nd, waitlist, NULL);
+  }
+}
+
+void cl::queue::add(const buffer_read &br, no_event_t,
+    const wait_list &waitlist, bool blocking)
+{
+  if(pimpl->get_profiler()) {
+    add(br, waitlist, blocking);
+  } else {
+    enqueue(br, waitlist, blocking, NULL);
+  }
+}
+
+void cl::queue::add(const buffer_write &bw, no_event_t,
+    const wait_list &waitlist, bool blocking)
+{
+  if(pimpl->get_profiler()) {
+    add(bw, waitlist, blocking);
+  } else {
+    enqueue(bw, waitlist, blocking, NULL);
+  }
+}
+
+cl::event cl::queue::add(const buffer_copy &bc, const wait_list &waitlist)
+{
   cl_event ev;
-  int cl_err = CL_SUCCESS;
+  enqueue(bc, waitlist, &ev);
 
-  cl_err = clEnqueueWriteBuffer(pimpl->get_command_queue(),
-      bw.buf.pimpl->get_mem(), blocking ? CL_TRUE : CL_FALSE,
-      bw.offsetbytes, bw.bytes, bw.src, waitevs.size(),
-      waitevs.size() ? &waitevs[0] : NULL, &ev);
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_copy", ret);
+  }
+
+  return ret;
+}
+
+cl::event cl::queue::add(const buffer_fill &bf, const wait_list &waitlist)
+{
+  cl_event ev;
+  enqueue(bf, waitlist, &ev);
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_fill", ret);
+  }
+
+  return ret;
+}
+
+void cl::queue::add(const buffer_copy &bc, no_event_t,
+    const wait_list &waitlist)
+{
+  if(pimpl->get_profiler()) {
+    add(bc, waitlist);
+  } else {
+    enqueue(bc, waitlist, NULL);
+  }
+}
+
+void cl::queue::add(const buffer_fill &bf, no_event_t,
+    const wait_list &waitlist)
+{
+  if(pimpl->get_profiler()) {
+    add(bf, waitlist);
+  } else {
+    enqueue(bf, waitlist, NULL);
+  }
+}
+
+cl::event cl::queue::add(const buffer_read_rect &br,
+    const wait_list &waitlist, bool blocking)
+{
+  cl_event ev;
+  enqueue(br, waitlist, blocking, &ev);
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_read_rect", ret);
+  }
 
-  return event(event::impl(ev, false));
+  return ret;
+}
+
+cl::event cl::queue::add(const buffer_write_rect &bw,
+    const wait_list &waitlist, bool blocking)
+{
+  cl_event ev;
+  enqueue(bw, waitlist, blocking, &ev);
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_write_rect", ret);
+  }
+
+  return ret;
+}
+
+cl::event cl::queue::add(const buffer_copy_rect &bc,
+    const wait_list &waitlist)
+{
+  cl_event ev;
+  enqueue(bc, waitlist, &ev);
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("buffer_copy_rect", ret);
+  }
+
+  return ret;
+}
+
+void cl::queue::add(const buffer_read_rect &br, no_event_t,
+    const wait_list &waitlist, bool blocking)
+{
+  if(pimpl->get_profiler()) {
+    add(br, waitlist, blocking);
+  } else {
+    enqueue(br, waitlist, blocking, NULL);
+  }
+}
+
+void cl::queue::add(const buffer_write_rect &bw, no_event_t,
+    const wait_list &waitlist, bool blocking)
+{
+  if(pimpl->get_profiler()) {
+    add(bw, waitlist, blocking);
+  } else {
+    enqueue(bw, waitlist, blocking, NULL);
+  }
+}
+
+void cl::queue::add(const buffer_copy_rect &bc, no_event_t,
+    const wait_list &waitlist)
+{
+  if(pimpl->get_profiler()) {
+    add(bc, waitlist);
+  } else {
+    enqueue(bc, waitlist, NULL);
+  }
+}
+
+cl::event cl::queue::migrate(const std::vector<buffer> &bufs,
+    unsigned int flags, const wait_list &waitlist)
+{
+#ifdef CL_VERSION_1_2
+  if(bufs.empty()) {
+    return marker(waitlist);
+  }
+
+  std::vector<cl_mem> mems;
+  mems.reserve(bufs.size());
+  for(std::vector<buffer>::const_iterator b = bufs.begin(); b != bufs.end();
+      ++b) {
+    mems.push_back(b->pimpl->get_mem());
+  }
+  cl_mem_migration_flags cl_flags = 0;
+  if(flags & MIGRATE_TO_HOST) {
+    cl_flags |= CL_MIGRATE_MEM_OBJECT_HOST;
+  }
+  if(flags & MIGRATE_CONTENT_UNDEFINED) {
+    cl_flags |= CL_MIGRATE_MEM_OBJECT_CONTENT_UNDEFINED;
+  }
+
+  cl_event ev;
+  cl_int cl_err = clEnqueueMigrateMemObjects(pimpl->get_command_queue(),
+      mems.size(), &mems[0], cl_flags, waitlist.size(),
+      waitlist.data(), &ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer migration");
+  }
+
+  event ret(ev);
+  if(pimpl->get_profiler()) {
+    pimpl->get_profiler()->record("migrate", ret);
+  }
+
+  return ret;
+#else
+  return marker(waitlist);
+#endif
+}
+
+cl::event cl::queue::marker(const wait_list &waitlist)
+{
+  const cl_command_queue q = pimpl->get_command_queue();
+  cl_event ev;
+#ifdef CL_VERSION_1_2
+  cl_int cl_err = clEnqueueMarkerWithWaitList(q, waitlist.size(),
+      waitlist.data(), &ev);
+#else
+  /* OpenCL 1.1 markers cannot wait for particular events, so hold back the
+   * queue until they are done instead.
+   */
+  cl_int cl_err = CL_SUCCESS;
+  if(!waitlist.empty()) {
+    cl_err = clEnqueueWaitForEvents(q, waitlist.size(), waitlist.data());
+  }
+  if(cl_err == CL_SUCCESS) {
+    cl_err = clEnqueueMarker(q, &ev);
+  }
+#endif
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue marker");
+  }
+
+  return event(ev);
+}
+
+cl::event cl::queue::barrier(const wait_list &waitlist)
+{
+  const cl_command_queue q = pimpl->get_command_queue();
+  cl_event ev;
+#ifdef CL_VERSION_1_2
+  cl_int cl_err = clEnqueueBarrierWithWaitList(q, waitlist.size(),
+      waitlist.data(), &ev);
+#else
+  cl_int cl_err = waitlist.empty() ? clEnqueueBarrier(q) :
+    clEnqueueWaitForEvents(q, waitlist.size(), waitlist.data());
+  if(cl_err == CL_SUCCESS) {
+    cl_err = clEnqueueMarker(q, &ev);
+  }
+#endif
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue barrier");
+  }
+
+  return event(ev);
+}
+
+void cl::queue::flush(void)
+{
+  cl_int cl_err = clFlush(pimpl->get_command_queue());
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to flush command queue");
+  }
+}
+
+void cl::queue::finish(void)
+{
+  cl_int cl_err = clFinish(pimpl->get_command_queue());
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to finish command queue");
+  }
+}
+
+namespace {
+  cl_map_flags unwrap_map_mode(cl::buffer_map::map_mode m)
+  {
+    switch(m) {
+      case cl::buffer_map::MAP_READ:
+        return CL_MAP_READ;
+      case cl::buffer_map::MAP_WRITE:
+        return CL_MAP_WRITE;
+      case cl::buffer_map::MAP_READ_WRITE:
+        return CL_MAP_READ | CL_MAP_WRITE;
+      case cl::buffer_map::MAP_OVERWRITE:
+#ifdef CL_VERSION_1_2
+        return CL_MAP_WRITE_INVALIDATE_REGION;
+#else
+        return CL_MAP_WRITE;
+#endif
+      default:
+        throw cl::error("unknown map mode");
+    }
+  }
+
+  _cl_event *map_buffer(cl_command_queue q, cl_mem m,
+      cl::buffer_map::map_mode mode, std::size_t cb, std::size_t os,
+      const cl::wait_list &waitlist, void *&ptr)
+  {
+    cl_event ev;
+    cl_int cl_err = CL_SUCCESS;
+    ptr = clEnqueueMapBuffer(q, m, CL_FALSE, unwrap_map_mode(mode), os, cb,
+        waitlist.size(), waitlist.data(), &ev, &cl_err);
+    if(cl_err != CL_SUCCESS) {
+      throw cl::error("unable to enqueue buffer map");
+    }
+
+    return ev;
+  }
+}
+
+cl::buffer_map::buffer_map(queue &qu, const buffer &b, map_mode m,
+    std::size_t cb, std::size_t os, const wait_list &waitlist)
+  : q(qu)
+  , buf(b)
+  , ptr(0)
+  , mapped(map_buffer(q.pimpl->get_command_queue(), buf.pimpl->get_mem(), m,
+        cb, os, waitlist, ptr))
+{
+  if(q.pimpl->get_profiler()) {
+    q.pimpl->get_profiler()->record("buffer_map", mapped);
+  }
+}
+
+cl::buffer_map::~buffer_map(void)
+{
+  if(!ptr) {
+    return;
+  }
+
+  try {
+    unmap();
+  } catch(const cl::error &e) {
+    std::cerr << e.what() << " in cl::buffer_map::~buffer_map" << std::endl;
+  }
+}
+
+const cl::event &cl::buffer_map::ready(void) const
+{
+  return mapped;
+}
+
+void *cl::buffer_map::data(void) const
+{
+  return ptr;
+}
+
+cl::event cl::buffer_map::unmap(const wait_list &waitlist)
+{
+  if(!ptr) {
+    throw cl::error("buffer is not mapped");
+  }
+
+  cl_event ev;
+  cl_int cl_err = clEnqueueUnmapMemObject(q.pimpl->get_command_queue(),
+      buf.pimpl->get_mem(), ptr, waitlist.size(), waitlist.data(), &ev);
+  if(cl_err != CL_SUCCESS) {
+    throw cl::error("unable to enqueue buffer unmap");
+  }
+  ptr = 0;
+
+  event ret(ev);
+  if(q.pimpl->get_profiler()) {
+    q.pimpl->get_profiler()->record("buffer_unmap", ret);
+  }
+
+  return ret;
 }
 
 cl::nd_run::nd_run(const kernel &kern, std::size_t global_dims[2],
@@ -159,6 +688,15 @@ cl::nd_run::nd_run(const kernel &kern, std::size_t global_dims[2],
   }
 }
 
+cl::nd_run::nd_run(const kernel &kern, unsigned work_dim,
+    const std::size_t *global_dims, const std::size_t *local_dims)
+  : k(kern), wd(work_dim), gd(global_dims, global_dims + work_dim), ld()
+{
+  if(local_dims != 0) {
+    ld = std::vector<std::size_t>(local_dims, local_dims + work_dim);
+  }
+}
+
 cl::nd_run::nd_run(const nd_run &nds)
   : k(nds.k), wd(nds.wd), gd(nds.gd), ld(nds.ld)
 {
@@ -249,6 +787,204 @@ void cl::buffer_write::swap(buffer_write &bw)
   std::swap(offsetbytes, bw.offsetbytes);
 }
 
+cl::buffer_copy::buffer_copy(const buffer &s, const buffer &d, std::size_t cb,
+    std::size_t src_os, std::size_t dst_os)
+  : src(s), dst(d), bytes(cb), src_offsetbytes(src_os)
+  , dst_offsetbytes(dst_os)
+{
+}
+
+cl::buffer_copy::buffer_copy(const buffer_copy &bc)
+  : src(bc.src), dst(bc.dst), bytes(bc.bytes)
+  , src_offsetbytes(bc.src_offsetbytes), dst_offsetbytes(bc.dst_offsetbytes)
+{
+}
+
+cl::buffer_copy &cl::buffer_copy::operator=(const buffer_copy &bc)
+{
+  buffer_copy newbc(bc);
+
+  swap(newbc);
+
+  return *this;
+}
+
+cl::buffer_copy::~buffer_copy(void)
+{
+}
+
+void cl::buffer_copy::swap(buffer_copy &bc)
+{
+  std::swap(src, bc.src);
+  std::swap(dst, bc.dst);
+  std::swap(bytes, bc.bytes);
+  std::swap(src_offsetbytes, bc.src_offsetbytes);
+  std::swap(dst_offsetbytes, bc.dst_offsetbytes);
+}
+
+cl::buffer_fill::buffer_fill(const buffer &b, const void *p,
+    std::size_t pattern_size, std::size_t cb, std::size_t os)
+  : buf(b)
+  , pattern(static_cast<const unsigned char *>(p),
+      static_cast<const unsigned char *>(p) + pattern_size)
+  , bytes(cb), offsetbytes(os)
+{
+  if(pattern.empty() || cb % pattern.size() || os % pattern.size()) {
+    throw cl::error("fill pattern does not divide the range to fill");
+  }
+}
+
+cl::buffer_fill::buffer_fill(const buffer_fill &bf)
+  : buf(bf.buf), pattern(bf.pattern), bytes(bf.bytes)
+  , offsetbytes(bf.offsetbytes)
+{
+}
+
+cl::buffer_fill &cl::buffer_fill::operator=(const buffer_fill &bf)
+{
+  buffer_fill newbf(bf);
+
+  swap(newbf);
+
+  return *this;
+}
+
+cl::buffer_fill::~buffer_fill(void)
+{
+}
+
+void cl::buffer_fill::swap(buffer_fill &bf)
+{
+  std::swap(buf, bf.buf);
+  std::swap(pattern, bf.pattern);
+  std::swap(bytes, bf.bytes);
+  std::swap(offsetbytes, bf.offsetbytes);
+}
+
+cl::rect_origin::rect_origin(std::size_t x, std::size_t y, std::size_t rp,
+    std::size_t z, std::size_t sp)
+  : row_pitch(rp), slice_pitch(sp)
+{
+  offset[0] = x;
+  offset[1] = y;
+  offset[2] = z;
+}
+
+cl::rect_extent::rect_extent(std::size_t row_bytes, std::size_t rows,
+    std::size_t slices)
+{
+  size[0] = row_bytes;
+  size[1] = rows;
+  size[2] = slices;
+}
+
+cl::buffer_read_rect::buffer_read_rect(const buffer &b, const rect_origin &bo,
+    void *d, const rect_origin &dsto, const rect_extent &r)
+  : buf(b), buf_origin(bo), dst(d), dst_origin(dsto), region(r)
+{
+}
+
+cl::buffer_read_rect::buffer_read_rect(const buffer_read_rect &br)
+  : buf(br.buf), buf_origin(br.buf_origin), dst(br.dst)
+  , dst_origin(br.dst_origin), region(br.region)
+{
+}
+
+cl::buffer_read_rect &cl::buffer_read_rect::operator=(
+    const buffer_read_rect &br)
+{
+  buffer_read_rect newbr(br);
+
+  swap(newbr);
+
+  return *this;
+}
+
+cl::buffer_read_rect::~buffer_read_rect(void)
+{
+}
+
+void cl::buffer_read_rect::swap(buffer_read_rect &br)
+{
+  std::swap(buf, br.buf);
+  std::swap(buf_origin, br.buf_origin);
+  std::swap(dst, br.dst);
+  std::swap(dst_origin, br.dst_origin);
+  std::swap(region, br.region);
+}
+
+cl::buffer_write_rect::buffer_write_rect(const buffer &b,
+    const rect_origin &bo, const void *s, const rect_origin &srco,
+    const rect_extent &r)
+  : buf(b), buf_origin(bo), src(s), src_origin(srco), region(r)
+{
+}
+
+cl::buffer_write_rect::buffer_write_rect(const buffer_write_rect &bw)
+  : buf(bw.buf), buf_origin(bw.buf_origin), src(bw.src)
+  , src_origin(bw.src_origin), region(bw.region)
+{
+}
+
+cl::buffer_write_rect &cl::buffer_write_rect::operator=(
+    const buffer_write_rect &bw)
+{
+  buffer_write_rect newbw(bw);
+
+  swap(newbw);
+
+  return *this;
+}
+
+cl::buffer_write_rect::~buffer_write_rect(void)
+{
+}
+
+void cl::buffer_write_rect::swap(buffer_write_rect &bw)
+{
+  std::swap(buf, bw.buf);
+  std::swap(buf_origin, bw.buf_origin);
+  std::swap(src, bw.src);
+  std::swap(src_origin, bw.src_origin);
+  std::swap(region, bw.region);
+}
+
+cl::buffer_copy_rect::buffer_copy_rect(const buffer &s,
+    const rect_origin &srco, const buffer &d, const rect_origin &dsto,
+    const rect_extent &r)
+  : src(s), src_origin(srco), dst(d), dst_origin(dsto), region(r)
+{
+}
+
+cl::buffer_copy_rect::buffer_copy_rect(const buffer_copy_rect &bc)
+  : src(bc.src), src_origin(bc.src_origin), dst(bc.dst)
+  , dst_origin(bc.dst_origin), region(bc.region)
+{
+}
+
+cl::buffer_copy_rect &cl::buffer_copy_rect::operator=(
+    const buffer_copy_rect &bc)
+{
+  buffer_copy_rect newbc(bc);
+
+  swap(newbc);
+
+  return *this;
+}
+
+cl::buffer_copy_rect::~buffer_copy_rect(void)
+{
+}
+
+void cl::buffer_copy_rect::swap(buffer_copy_rect &bc)
+{
+  std::swap(src, bc.src);
+  std::swap(src_origin, bc.src_origin);
+  std::swap(dst, bc.dst);
+  std::swap(dst_origin, bc.dst_origin);
+  std::swap(region, bc.region);
+}
+
 template<>
 void std::swap(cl::nd_run &a, cl::nd_run &b)
 {
@@ -266,3 +1002,33 @@ void std::swap(cl::buffer_write &a, cl::buffer_write &b)
 {
   a.swap(b);
 }
+
+template<>
+void std::swap(cl::buffer_copy &a, cl::buffer_copy &b)
+{
+  a.swap(b);
+}
+
+template<>
+void std::swap(cl::buffer_fill &a, cl::buffer_fill &b)
+{
+  a.swap(b);
+}
+
+template<>
+void std::swap(cl::buffer_read_rect &a, cl::buffer_read_rect &b)
+{
+  a.swap(b);
+}
+
+template<>
+void std::swap(cl::buffer_write_rect &a, cl::buffer_write_rect &b)
+{
+  a.swap(b);
+}
+
+template<>
+void std::swap(cl::buffer_copy_rect &a, cl::buffer_copy_rect &b)
+{
+  a.swap(b);
+}
@@ -11,6 +11,12 @@
 namespace cl {
   class queue;
   class buffer;
+  class profiler;
+
+  //! Tag for queue::add overloads which do not return an event
+  struct no_event_t {
+  };
+  const no_event_t no_event = no_event_t();
 
   class nd_run {
     private:
@@ -21,6 +27,10 @@ namespace cl {
     public:
     nd_run(const kernel &kern, std::size_t global_dims[2],
         std::size_t local_dims[2] = 0);
+    //! Range of work_dim (1 to 3) dimensions
+    /*! local_dims may be null to let the implementation choose. */
+    nd_run(const kernel &kern, unsigned work_dim,
+        const std::size_t *global_dims, const std::size_t *local_dims = 0);
     nd_run(const nd_run &nds);
     nd_run &operator=(const nd_run &nds);
     ~nd_run(void);
@@ -28,6 +38,7 @@ namespace cl {
     void swap(nd_run &nd);
 
     friend class queue;
+    friend class command_list;
   };
 
   class buffer_read {
@@ -50,6 +61,7 @@ namespace cl {
     void swap(buffer_read &br);
 
     friend class queue;
+    friend class command_list;
   };
 
   class buffer_write {
@@ -71,9 +83,147 @@ namespace cl {
 
     void swap(buffer_write &bw);
 
+    friend class queue;
+    friend class command_list;
+  };
+
+  class buffer_copy {
+    private:
+    buffer src;
+    buffer dst;
+    std::size_t bytes;
+    std::size_t src_offsetbytes;
+    std::size_t dst_offsetbytes;
+
+    public:
+    //! Setup to copy cb bytes between buffers on the device
+    /*! The ranges may not overlap if src and dst are the same buffer. */
+    buffer_copy(const buffer &src, const buffer &dst, std::size_t cb,
+        std::size_t src_os = 0, std::size_t dst_os = 0);
+    buffer_copy(const buffer_copy &bc);
+    buffer_copy &operator=(const buffer_copy &bc);
+    ~buffer_copy(void);
+
+    void swap(buffer_copy &bc);
+
+    friend class queue;
+  };
+
+  class buffer_fill {
+    private:
+    buffer buf;
+    std::vector<unsigned char> pattern;
+    std::size_t bytes;
+    std::size_t offsetbytes;
+
+    public:
+    //! Setup to fill cb bytes of a buffer with copies of a pattern
+    /*! The pattern is copied. Its size has to be 1, 2, 4, ... or 128 bytes,
+     *  and divide both cb and the offset os.
+     */
+    buffer_fill(const buffer &buf, const void *pattern,
+        std::size_t pattern_size, std::size_t cb, std::size_t os = 0);
+    buffer_fill(const buffer_fill &bf);
+    buffer_fill &operator=(const buffer_fill &bf);
+    ~buffer_fill(void);
+
+    void swap(buffer_fill &bf);
+
+    friend class queue;
+  };
+
+  //! Position of a rectangular region within memory laid out in rows
+  /*! x counts bytes, y rows and z slices. Zero pitches mean rows and slices
+   *  follow each other without gaps.
+   */
+  class rect_origin {
+    private:
+    std::size_t offset[3];
+    std::size_t row_pitch;
+    std::size_t slice_pitch;
+
+    public:
+    rect_origin(std::size_t x, std::size_t y, std::size_t row_pitch,
+        std::size_t z = 0, std::size_t slice_pitch = 0);
+
     friend class queue;
   };
 
+  //! Extent of a rectangular region, bytes per row, rows and slices
+  class rect_extent {
+    private:
+    std::size_t size[3];
+
+    public:
+    rect_extent(std::size_t row_bytes, std::size_t rows,
+        std::size_t slices = 1);
+
+    friend class queue;
+  };
+
+  class buffer_read_rect {
+    private:
+    buffer buf;
+    rect_origin buf_origin;
+    void *dst;
+    rect_origin dst_origin;
+    rect_extent region;
+
+    public:
+    //! Setup to read region from buf at bo to dst at dsto
+    buffer_read_rect(const buffer &buf, const rect_origin &bo, void *dst,
+        const rect_origin &dsto, const rect_extent &region);
+    buffer_read_rect(const buffer_read_rect &br);
+    buffer_read_rect &operator=(const buffer_read_rect &br);
+    ~buffer_read_rect(void);
+
+    void swap(buffer_read_rect &br);
+
+    friend class queue;
+  };
+
+  class buffer_write_rect {
+    private:
+    buffer buf;
+    rect_origin buf_origin;
+    const void *src;
+    rect_origin src_origin;
+    rect_extent region;
+
+    public:
+    //! Setup to write region from src at srco to buf at bo
+    buffer_write_rect(const buffer &buf, const rect_origin &bo,
+        const void *src, const rect_origin &srco, const rect_extent &region);
+    buffer_write_rect(const buffer_write_rect &bw);
+    buffer_write_rect &operator=(const buffer_write_rect &bw);
+    ~buffer_write_rect(void);
+
+    void swap(buffer_write_rect &bw);
+
+    friend class queue;
+  };
+
+  class buffer_copy_rect {
+    private:
+    buffer src;
+    rect_origin src_origin;
+    buffer dst;
+    rect_origin dst_origin;
+    rect_extent region;
+
+    public:
+    //! Setup to copy region from src at srco to dst at dsto on the device
+    /*! The regions may not overlap if src and dst are the same buffer. */
+    buffer_copy_rect(const buffer &src, const rect_origin &srco,
+        const buffer &dst, const rect_origin &dsto, const rect_extent &region);
+    buffer_copy_rect(const buffer_copy_rect &bc);
+    buffer_copy_rect &operator=(const buffer_copy_rect &bc);
+    ~buffer_copy_rect(void);
+
+    void swap(buffer_copy_rect &bc);
+
+    friend class queue;
+  };
 
   class queue {
     private:
@@ -82,27 +232,76 @@ namespace cl {
 
     explicit queue(const impl &i);
 
+    /* Enqueue a command, ev receives its event unless it is null */
+    void enqueue(const nd_run &nd, const wait_list &waitlist, _cl_event **ev);
+    void enqueue(const buffer_read &br, const wait_list &waitlist,
+        bool blocking, _cl_event **ev);
+    void enqueue(const buffer_write &bw, const wait_list &waitlist,
+        bool blocking, _cl_event **ev);
+    void enqueue(const buffer_copy &bc, const wait_list &waitlist,
+        _cl_event **ev);
+    void enqueue(const buffer_fill &bf, const wait_list &waitlist,
+        _cl_event **ev);
+    void enqueue(const buffer_read_rect &br, const wait_list &waitlist,
+        bool blocking, _cl_event **ev);
+    void enqueue(const buffer_write_rect &bw, const wait_list &waitlist,
+        bool blocking, _cl_event **ev);
+    void enqueue(const buffer_copy_rect &bc, const wait_list &waitlist,
+        _cl_event **ev);
+
     public:
     queue(const queue &q);
     queue &operator=(const queue &q);
     ~queue(void);
 
+    //! Properties of a command queue, combined with |
+    enum queue_property {
+      //! Commands run one after the other, in the order enqueued
+      QUEUE_IN_ORDER = 0,
+      //! Commands only wait for the events they are given
+      QUEUE_OUT_OF_ORDER = 1 << 0,
+      //! Events carry timestamps, see event::profile()
+      QUEUE_PROFILING = 1 << 1
+    };
+
     //! Create command queue for a device in a context
-    static queue create(const context &c, const device &d);
+    /*! props is a combination of queue_property values. */
+    static queue create(const context &c, const device &d,
+        unsigned int props = QUEUE_OUT_OF_ORDER);
+
+    //! Create a command queue for each device of a context
+    /*! The queues are in the order of context::devices(). */
+    static std::vector<queue> create_all(const context &c,
+        unsigned int props = QUEUE_OUT_OF_ORDER);
+
+    //! Obtain the device the queue submits to
+    device get_device(void) const;
+
+    //! Obtain the queue_property values the queue was created with
+    unsigned int properties(void) const;
+
+    //! Record every command enqueued from now on in prof
+    /*! The queue has to be created with profiling, and prof has to outlive
+     *  the queue and its copies made afterwards. A null prof stops recording.
+     */
+    void set_profiler(profiler *prof);
+
+    //! Obtain the profiler the queue records in, null if none
+    profiler *get_profiler(void) const;
 
     //! Enqueue a data-parallel kernel
     /*! Takes an optional list of events which need to complete before this
      *  kernel should be run.
      */
     event add(const nd_run &nd,
-        const std::vector<event> &waitlist = std::vector<event>());
+        const wait_list &waitlist = wait_list());
 
     //! Enqueue a buffer read
     /*! Takes an optional list of events which need to complete before this
      *  read should proceed. Can be blocking or non-blocking (default).
      */
     event add(const buffer_read &br,
-        const std::vector<event> &waitlist = std::vector<event>(),
+        const wait_list &waitlist = wait_list(),
         bool blocking = false);
 
     //! Enqueue a buffer write
@@ -110,8 +309,128 @@ namespace cl {
      *  write should proceed. Can be blocking or non-blocking (default).
      */
     event add(const buffer_write &bw,
-        const std::vector<event> &waitlist = std::vector<event>(),
+        const wait_list &waitlist = wait_list(),
         bool blocking = true);
+
+    /* The no_event overloads enqueue the same commands without asking the
+     * driver for an event, for commands nothing waits on explicitly, e.g. on
+     * an in-order queue. An attached profiler still gets its events.
+     */
+    void add(const nd_run &nd, no_event_t,
+        const wait_list &waitlist = wait_list());
+    void add(const buffer_read &br, no_event_t,
+        const wait_list &waitlist = wait_list(), bool blocking = false);
+    void add(const buffer_write &bw, no_event_t,
+        const wait_list &waitlist = wait_list(), bool blocking = true);
+
+    //! Enqueue a copy between buffers
+    event add(const buffer_copy &bc,
+        const wait_list &waitlist = wait_list());
+    //! Enqueue a buffer fill
+    /*! Before OpenCL 1.2 the fill is a blocking write of the pattern. */
+    event add(const buffer_fill &bf,
+        const wait_list &waitlist = wait_list());
+
+    void add(const buffer_copy &bc, no_event_t,
+        const wait_list &waitlist = wait_list());
+    void add(const buffer_fill &bf, no_event_t,
+        const wait_list &waitlist = wait_list());
+
+    //! Enqueue a rectangular buffer read, non-blocking by default
+    event add(const buffer_read_rect &br,
+        const wait_list &waitlist = wait_list(),
+        bool blocking = false);
+    //! Enqueue a rectangular buffer write, blocking by default
+    event add(const buffer_write_rect &bw,
+        const wait_list &waitlist = wait_list(),
+        bool blocking = true);
+    //! Enqueue a rectangular copy between buffers
+    event add(const buffer_copy_rect &bc,
+        const wait_list &waitlist = wait_list());
+
+    void add(const buffer_read_rect &br, no_event_t,
+        const wait_list &waitlist = wait_list(), bool blocking = false);
+    void add(const buffer_write_rect &bw, no_event_t,
+        const wait_list &waitlist = wait_list(), bool blocking = true);
+    void add(const buffer_copy_rect &bc, no_event_t,
+        const wait_list &waitlist = wait_list());
+
+    //! Where queue::migrate moves buffers, combined with |
+    enum migrate_flag {
+      //! To the device of the queue
+      MIGRATE_TO_DEVICE = 0,
+      //! To the host
+      MIGRATE_TO_HOST = 1 << 0,
+      //! The contents need not be moved, they are about to be overwritten
+      MIGRATE_CONTENT_UNDEFINED = 1 << 1
+    };
+
+    //! Move bufs ahead of their use on the device of the queue, or the host
+    /*! flags is a combination of migrate_flag values. Before OpenCL 1.2 the
+     *  implementation moves buffers on first use anyway, and this only
+     *  enqueues a marker on waitlist.
+     */
+    event migrate(const std::vector<buffer> &bufs,
+        unsigned int flags = MIGRATE_TO_DEVICE,
+        const wait_list &waitlist = wait_list());
+
+    //! Enqueue a marker, completing once waitlist has
+    /*! An empty waitlist means all commands enqueued before. */
+    event marker(const wait_list &waitlist = wait_list());
+
+    //! Enqueue a barrier, later commands wait until waitlist has completed
+    /*! An empty waitlist means all commands enqueued before. */
+    event barrier(const wait_list &waitlist = wait_list());
+
+    //! Submit all enqueued commands to the device
+    void flush(void);
+
+    //! Wait until all enqueued commands have completed
+    void finish(void);
+
+    friend class command_list;
+    friend class buffer_map;
+  };
+
+  //! A region of a buffer mapped into host memory while this lives
+  /*! The map is enqueued without blocking, the region may be accessed once
+   *  ready() has completed. It is unmapped by unmap() or on destruction.
+   *  Buffers created in host memory are mapped in place, without copies.
+   */
+  class buffer_map {
+    private:
+    queue q;
+    buffer buf;
+    void *ptr;
+    event mapped;
+
+    buffer_map(const buffer_map &bm);
+    buffer_map &operator=(const buffer_map &bm);
+
+    public:
+    enum map_mode {
+      MAP_READ,
+      MAP_WRITE,
+      MAP_READ_WRITE,
+      //! Write only, the previous contents need not be made visible
+      MAP_OVERWRITE
+    };
+
+    //! Map cb bytes of buf from offset os once waitlist has completed
+    buffer_map(queue &q, const buffer &buf, map_mode m, std::size_t cb,
+        std::size_t os = 0, const wait_list &waitlist = wait_list());
+    ~buffer_map(void);
+
+    //! Event completing once the region is accessible on the host
+    const event &ready(void) const;
+
+    //! Start of the mapped region
+    void *data(void) const;
+
+    //! Enqueue the unmap now, after waitlist, and return its event
+    /*! The buffer may be used by other commands once the event completes.
+     */
+    event unmap(const wait_list &waitlist = wait_list());
   };
 };
 
@@ -119,6 +438,11 @@ namespace std {
   template<> void swap(cl::nd_run &a, cl::nd_run &b);
   template<> void swap(cl::buffer_read &a, cl::buffer_read &b);
   template<> void swap(cl::buffer_write &a, cl::buffer_write &b);
+  template<> void swap(cl::buffer_copy &a, cl::buffer_copy &b);
+  template<> void swap(cl::buffer_fill &a, cl::buffer_fill &b);
+  template<> void swap(cl::buffer_read_rect &a, cl::buffer_read_rect &b);
+  template<> void swap(cl::buffer_write_rect &a, cl::buffer_write_rect &b);
+  template<> void swap(cl::buffer_copy_rect &a, cl::buffer_copy_rect &b);
 };
 
 #endif /* CLPP_CL_QUEUE_HEADER_INCLUDED */
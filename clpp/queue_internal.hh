@@ -7,6 +7,7 @@
 class cl::queue::impl {
   private:
   cl_command_queue command_queue;
+  profiler *prof;
 
   public:
   impl(const cl_command_queue q, bool retain = true);
@@ -15,6 +16,9 @@ class cl::queue::impl {
   impl &operator=(const impl &i);
 
   cl_command_queue get_command_queue(void) const;
+
+  profiler *get_profiler(void) const;
+  void set_profiler(profiler *p);
 };
 
 #endif /* CLPP_CL_QUEUE_INTERNAL_HH_INCLUDED */
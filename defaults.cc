@@ -6,8 +6,26 @@
 defaults::defaults(void)
   : verbosity(false)
   , synch_ops(false)
+  , vector_strips(false)
+  , double_prec(false)
+  , cache_programs(true)
+  , specialize_kernels(true)
+  , in_order_queue(false)
+  , numa_split(false)
+  , lattice_mem(cl::mem::MEM_HOST_NONE)
   , dtype(cl::device::CPU)
+  , stype(JACOBI)
+  , max_iters(10000)
+  , block_sweep_count(1)
+  , check_every(100)
+  , repeat_count(1)
+  , pool_mib(0)
+  , num_devices(1)
+  , tol(1e-5f)
+  , batch_path()
 {
+  lattice.dim[0] = lattice.dim[1] = 224;
+  local.dim[0] = local.dim[1] = 16;
 }
 
 /* copy constructor defaults::defaults(const defaults &) intentionally not
@@ -32,29 +50,112 @@ bool defaults::synch(void) const
   return synch_ops;
 }
 
+bool defaults::vectorize(void) const
+{
+  return vector_strips;
+}
+
+bool defaults::double_precision(void) const
+{
+  return double_prec;
+}
+
+bool defaults::program_cache(void) const
+{
+  return cache_programs;
+}
+
+bool defaults::specialize(void) const
+{
+  return specialize_kernels;
+}
+
+bool defaults::in_order(void) const
+{
+  return in_order_queue;
+}
+
+cl::mem::mem_host defaults::lattice_memory(void) const
+{
+  return lattice_mem;
+}
+
 cl::device::type defaults::dev_type(void) const
 {
   return dtype;
 }
 
-defaults::area defaults::lattice_size(void) const
+unsigned defaults::device_count(void) const
 {
-  area ret;
-  ret.dim[0] = 224;
-  ret.dim[1] = 224;
+  return num_devices;
+}
 
-  return ret;
+bool defaults::numa(void) const
+{
+  return numa_split;
+}
+
+defaults::solver_type defaults::solver(void) const
+{
+  return stype;
+}
+
+unsigned defaults::max_iterations(void) const
+{
+  return max_iters;
+}
+
+unsigned defaults::block_sweeps(void) const
+{
+  return block_sweep_count;
+}
+
+unsigned defaults::check_interval(void) const
+{
+  return check_every;
+}
+
+unsigned defaults::repeats(void) const
+{
+  return repeat_count;
+}
+
+unsigned defaults::pool_limit(void) const
+{
+  return pool_mib;
+}
+
+float defaults::tolerance(void) const
+{
+  return tol;
+}
+
+defaults::area defaults::lattice_size(void) const
+{
+  return lattice;
 }
 
 defaults::area defaults::local_size(void) const
+{
+  return local;
+}
+
+defaults::area defaults::global_size(void) const
 {
   area ret;
-  ret.dim[0] = 16;
-  ret.dim[1] = 16;
+  for(unsigned i = 0; i < 2; ++i) {
+    ret.dim[i] = (lattice.dim[i] + local.dim[i] - 1)/local.dim[i]*
+      local.dim[i];
+  }
 
   return ret;
 }
 
+const std::string &defaults::batch_file(void) const
+{
+  return batch_path;
+}
+
 defaults &defaults::get(void)
 {
   static defaults defs;
@@ -71,8 +172,45 @@ void defaults::process_arguments(int argc, char **argv)
       ("help,h", "produce help message")
       ("verbose,v", "enable verbose output")
       ("synch", "enable synchronous operations")
+      ("vectorize", "update four-wide strips of cells per Jacobi work item")
+      ("double", "solve in double precision (needs cl_khr_fp64)")
+      ("no-cache", "always build the kernels from source")
+      ("no-specialize", "read the lattice constants at run time in the "
+        "Jacobi kernels instead of building them in")
+      ("in-order", "use an in-order command queue and skip the events of "
+        "the steps between residual checks")
+      ("host-memory", "keep the lattices in page aligned host memory, which "
+        "CPU devices use in place and results are mapped from, not copied")
+      ("huge-pages", "as --host-memory, backed by huge pages where the "
+        "system allows")
       ("device,d", po::value<cl::device::type>(&get().dtype),
         "select device type (CPU, GPU)")
+      ("devices", po::value<unsigned>(&get().num_devices),
+        "number of devices of the type to share one context (default 1)")
+      ("numa", "split the device into one sub-device per NUMA domain, "
+        "in place of --devices (OpenCL 1.2)")
+      ("solver,s", po::value<solver_type>(&get().stype),
+        "select solver (jacobi, jacobi-inplace, sor, multigrid, cg, bands)")
+      ("max-iterations", po::value<unsigned>(&get().max_iters),
+        "maximum number of sweeps (default 10000)")
+      ("block-sweeps", po::value<unsigned>(&get().block_sweep_count),
+        "Jacobi sweeps per launch, done in local memory, dividing "
+        "--max-iterations (default 1)")
+      ("check-interval", po::value<unsigned>(&get().check_every),
+        "sweeps between residual checks (default 100)")
+      ("repeat", po::value<unsigned>(&get().repeat_count),
+        "run the solve this many times, reusing buffers (default 1)")
+      ("pool-limit", po::value<unsigned>(&get().pool_mib),
+        "most device memory held for buffers in MiB (default no limit)")
+      ("tolerance", po::value<float>(&get().tol),
+        "stop once no cell changes by more than this (default 1e-5)")
+      ("lattice-size", po::value<area>(&get().lattice),
+        "cells of the lattice, WIDTHxHEIGHT (default 224x224)")
+      ("local-size", po::value<area>(&get().local),
+        "work group size, WIDTHxHEIGHT (default 16x16)")
+      ("batch", po::value<std::string>(&get().batch_path),
+        "solve one problem per line of this file, each line giving the left, "
+        "right and top boundary amplitudes (jacobi only)")
   ;
 
   po::variables_map vm;
@@ -95,4 +233,61 @@ void defaults::process_arguments(int argc, char **argv)
     }
     get().synch_ops = true;
   }
+
+  if(vm.count("vectorize")) {
+    get().vector_strips = true;
+  }
+
+  if(vm.count("double")) {
+    get().double_prec = true;
+  }
+
+  if(vm.count("no-cache")) {
+    get().cache_programs = false;
+  }
+
+  if(vm.count("no-specialize")) {
+    get().specialize_kernels = false;
+  }
+
+  if(vm.count("in-order")) {
+    get().in_order_queue = true;
+  }
+
+  if(vm.count("numa")) {
+    get().numa_split = true;
+  }
+
+  if(vm.count("huge-pages")) {
+    get().lattice_mem = cl::mem::MEM_HOST_HUGE_PAGES;
+  } else if(vm.count("host-memory")) {
+    get().lattice_mem = cl::mem::MEM_HOST_PAGES;
+  }
+
+  if(get().check_every == 0) {
+    throw std::runtime_error("check interval must be positive");
+  }
+  if(get().num_devices == 0) {
+    throw std::runtime_error("at least one device is needed");
+  }
+  if(get().repeat_count == 0) {
+    throw std::runtime_error("repeat count must be positive");
+  }
+  if(get().block_sweep_count == 0) {
+    throw std::runtime_error("sweeps per launch must be positive");
+  }
+  if(get().max_iters % get().block_sweep_count != 0) {
+    throw std::runtime_error(
+        "maximum iterations must be a multiple of the sweeps per launch");
+  }
+  if(get().lattice.dim[0] < 3 || get().lattice.dim[1] < 3) {
+    throw std::runtime_error("lattice needs at least 3x3 cells");
+  }
+  if(get().local.dim[0] == 0 || get().local.dim[1] == 0) {
+    throw std::runtime_error("work group size must be positive");
+  }
+  if(!get().batch_path.empty() && get().stype != JACOBI &&
+      get().stype != JACOBI_INPLACE) {
+    throw std::runtime_error("batched solves need a jacobi solver");
+  }
 }
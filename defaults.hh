@@ -1,13 +1,53 @@
 #ifndef DEFAULT_HH_INCLUDED
 #define DEFAULT_HH_INCLUDED
 
+#include <string>
+#include "clpp/buffer.hh"
 #include "clpp/device.hh"
 
 class defaults {
+  public:
+  enum solver_type {
+    //! Jacobi sweeps alternating between two state buffers
+    JACOBI,
+    //! Jacobi sweeps updating a single state buffer in place (racy)
+    JACOBI_INPLACE,
+    //! Red-black successive over-relaxation
+    SOR,
+    //! Geometric multigrid V-cycles
+    MULTIGRID,
+    //! Conjugate gradients
+    CG,
+    //! Jacobi sweeps of horizontal bands, one per device, exchanging halos
+    BANDS
+  };
+
+  struct area {
+    std::size_t dim[2];
+  };
+
   private:
   bool verbosity;
   bool synch_ops;
+  bool vector_strips;
+  bool double_prec;
+  bool cache_programs;
+  bool specialize_kernels;
+  bool in_order_queue;
+  bool numa_split;
+  cl::mem::mem_host lattice_mem;
   cl::device::type dtype;
+  solver_type stype;
+  unsigned max_iters;
+  unsigned block_sweep_count;
+  unsigned check_every;
+  unsigned repeat_count;
+  unsigned pool_mib;
+  unsigned num_devices;
+  float tol;
+  area lattice;
+  area local;
+  std::string batch_path;
 
   defaults(void);
   defaults(const defaults &def);
@@ -18,15 +58,135 @@ class defaults {
   public:
   bool verbose(void) const;
   bool synch(void) const;
+  //! Use the vectorized strip kernel for Jacobi sweeps
+  bool vectorize(void) const;
+  //! Solve in double rather than single precision
+  bool double_precision(void) const;
+  //! Keep built program binaries on disk between runs
+  bool program_cache(void) const;
+  //! Build the lattice constants into the Jacobi kernels
+  bool specialize(void) const;
+  //! Run the solvers on an in-order queue, with events only where needed
+  bool in_order(void) const;
+  //! Where the lattice buffers are kept
+  cl::mem::mem_host lattice_memory(void) const;
   cl::device::type dev_type(void) const;
-  struct area {
-    std::size_t dim[2];
-  };
+  //! Number of devices of dev_type() sharing the context
+  unsigned device_count(void) const;
+  //! Split the device into one sub-device per NUMA domain
+  bool numa(void) const;
+  solver_type solver(void) const;
+  //! Upper bound on the number of sweeps
+  unsigned max_iterations(void) const;
+  //! Number of Jacobi sweeps per kernel launch
+  unsigned block_sweeps(void) const;
+  //! Number of sweeps between residual checks
+  unsigned check_interval(void) const;
+  //! Number of times the solve is run, reusing its buffers
+  unsigned repeats(void) const;
+  //! Most device memory the buffer pool may hold in MiB, 0 for no limit
+  unsigned pool_limit(void) const;
+  //! Largest change of any cell at which a solve counts as converged
+  float tolerance(void) const;
+  //! Number of cells in each direction
   area lattice_size(void) const;
+  //! Work group size of the lattice kernels
   area local_size(void) const;
+  //! Lattice size rounded up to whole work groups
+  area global_size(void) const;
+  //! File listing the boundary amplitudes of a batch, empty for single solves
+  const std::string &batch_file(void) const;
 
   static defaults &get(void);
   static void process_arguments(int argc, char **argv);
 };
 
+#include <iostream>
+
+template<typename CharT, typename Traits>
+std::basic_istream<CharT, Traits>&
+operator>>(std::basic_istream<CharT, Traits> &is, defaults::solver_type &t)
+{
+  /* Eat up white space */
+  is >> std::ws;
+  std::basic_string<CharT, Traits> s;
+  is >> s;
+
+  if(s.compare("jacobi") == 0) {
+    t = defaults::JACOBI;
+  } else if(s.compare("jacobi-inplace") == 0) {
+    t = defaults::JACOBI_INPLACE;
+  } else if(s.compare("sor") == 0) {
+    t = defaults::SOR;
+  } else if(s.compare("multigrid") == 0) {
+    t = defaults::MULTIGRID;
+  } else if(s.compare("cg") == 0) {
+    t = defaults::CG;
+  } else if(s.compare("bands") == 0) {
+    t = defaults::BANDS;
+  } else {
+    is.setstate(std::ios_base::failbit);
+  }
+
+  return is;
+}
+
+template<typename CharT, typename Traits>
+std::basic_ostream<CharT, Traits>&
+operator<<(std::basic_ostream<CharT, Traits> &os, defaults::solver_type t)
+{
+  switch(t) {
+    case defaults::JACOBI:
+      os << "jacobi";
+      break;
+    case defaults::JACOBI_INPLACE:
+      os << "jacobi-inplace";
+      break;
+    case defaults::SOR:
+      os << "sor";
+      break;
+    case defaults::MULTIGRID:
+      os << "multigrid";
+      break;
+    case defaults::CG:
+      os << "cg";
+      break;
+    case defaults::BANDS:
+      os << "bands";
+      break;
+  }
+  return os;
+}
+
+/* Areas are written as WIDTHxHEIGHT, a single number gives a square */
+template<typename CharT, typename Traits>
+std::basic_istream<CharT, Traits>&
+operator>>(std::basic_istream<CharT, Traits> &is, defaults::area &a)
+{
+  std::size_t w = 0, h = 0;
+  is >> w;
+  if(is.eof()) {
+    h = w;
+  } else {
+    CharT sep = 0;
+    if(!(is >> sep) || (sep != 'x' && sep != 'X') || !(is >> h)) {
+      is.setstate(std::ios_base::failbit);
+      return is;
+    }
+  }
+  if(is) {
+    a.dim[0] = w;
+    a.dim[1] = h;
+  }
+
+  return is;
+}
+
+template<typename CharT, typename Traits>
+std::basic_ostream<CharT, Traits>&
+operator<<(std::basic_ostream<CharT, Traits> &os, const defaults::area &a)
+{
+  return os << a.dim[0] << 'x' << a.dim[1];
+}
+
 #endif /* DEFAULT_HH_INCLUDED */
@@ -0,0 +1,28 @@
+# Write the contents of INPUT into OUTPUT as a C++ byte array named SYMBOL,
+# with its length in SYMBOL_size. Run as
+#   cmake -DINPUT=file -DOUTPUT=file.cc -DSYMBOL=name -P embed.cmake
+# An INPUT which does not exist gives an empty array.
+
+if(EXISTS "${INPUT}")
+  file(READ "${INPUT}" hex HEX)
+else(EXISTS "${INPUT}")
+  set(hex "")
+endif(EXISTS "${INPUT}")
+
+string(LENGTH "${hex}" hex_len)
+math(EXPR size "${hex_len} / 2")
+# Turn every pair of hex digits into an initializer, 16 to a line
+string(REGEX REPLACE "([0-9a-f][0-9a-f])" "0x\\1," bytes "${hex}")
+set(line "")
+foreach(i RANGE 15)
+  set(line "${line}0x..,")
+endforeach(i)
+string(REGEX REPLACE "(${line})" "\\1\n  " bytes "${bytes}")
+
+file(WRITE "${OUTPUT}"
+  "/* Generated by embed.cmake from ${INPUT}, do not edit */\n"
+  "#include <cstddef>\n\n"
+  "extern const unsigned char ${SYMBOL}[] = {\n"
+  "  ${bytes}0x00\n"
+  "};\n"
+  "extern const std::size_t ${SYMBOL}_size = ${size};\n")
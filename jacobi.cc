@@ -0,0 +1,141 @@
+#include <stdexcept>
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  cl::nd_run make_jacobi_run(solver_env &env, const cl::buffer &input,
+      const cl::buffer &output, const cl::buffer &diffs, unsigned halo)
+  {
+    cl::kernel jac_kernel = env.get_kernel(
+        halo > 1 ? "jacobi_block_step" : "jacobi_step");
+    jac_kernel.argv()[0] <<= env.params_buf;
+    jac_kernel.argv()[1] <<= input;
+    jac_kernel.argv()[2] <<= output;
+    jac_kernel.argv()[3] <<= diffs;
+    // Figure out local space req'd (two additional rows and columns) and add
+    // local space to the jacobian kernel. Blocked sweeps need a halo as deep
+    // as the number of sweeps, and two copies of the tile.
+    if(halo > 1) {
+      jac_kernel.argv()[4] <<= cl::local_space(2*env.real_size*
+          (defaults::get().local_size().dim[0] + 2*halo)*
+          (defaults::get().local_size().dim[1] + 2*halo));
+    } else {
+      jac_kernel.argv()[4] <<= cl::local_space(env.real_size*
+          (defaults::get().local_size().dim[0] + 2)*
+          (defaults::get().local_size().dim[1] + 2));
+    }
+
+    return batch_run(env, jac_kernel, defaults::get().global_size().dim,
+        defaults::get().local_size().dim);
+  }
+
+  cl::nd_run make_strip_run(solver_env &env, const cl::buffer &input,
+      const cl::buffer &output, const cl::buffer &diffs)
+  {
+    if(env.params.global_row_stride % 4 != 0) {
+      throw std::runtime_error(
+          "vectorized sweeps need a row stride divisible by four");
+    }
+
+    cl::kernel strip_kernel = env.get_kernel("jacobi_strip_step");
+    strip_kernel.argv()[0] <<= env.params_buf;
+    strip_kernel.argv()[1] <<= input;
+    strip_kernel.argv()[2] <<= output;
+    strip_kernel.argv()[3] <<= diffs;
+
+    // Each work item covers four columns and a strip of rows, let the runtime
+    // pick the work group size.
+    std::size_t strips[2] = {
+      (env.params.global_dims[0] + 3)/4,
+      (env.params.global_dims[1] + JACOBI_STRIP_ROWS - 1)/JACOBI_STRIP_ROWS
+    };
+    return batch_run(env, strip_kernel, strips);
+  }
+
+  /* Even steps go through the first run, odd steps through the second.
+   * Pairs of steps are replayed from a recorded list.
+   */
+  class jacobi_sweeper : public sweeper {
+    private:
+    std::vector<cl::nd_run> runs;
+    unsigned sweeps_per_run;
+    cl::command_list pair;
+
+    public:
+    jacobi_sweeper(const std::vector<cl::nd_run> &r, unsigned sweeps)
+      : runs(r), sweeps_per_run(sweeps)
+    {
+      pair.add(runs[0]);
+      pair.add(runs[1], cl::command_list::dependencies(1, 0));
+    }
+
+    cl::event step(cl::queue &q, unsigned n, const cl::event &after)
+    {
+      return q.add(runs[n % runs.size()], after);
+    }
+
+    cl::event steps(cl::queue &q, unsigned n, unsigned count,
+        const cl::event &after)
+    {
+      cl::event ev = after;
+      if(count > 0 && n % 2) {
+        ev = step(q, n++, ev);
+        --count;
+      }
+      if(count >= 2) {
+        ev = pair.replay(q, count/2, ev);
+        n += count/2*2;
+      }
+      if(count % 2) {
+        ev = step(q, n, ev);
+      }
+
+      return ev;
+    }
+
+    unsigned iterations_per_step(void) const
+    {
+      return sweeps_per_run;
+    }
+  };
+}
+
+solve_result solve_jacobi(solver_env &env, const cl::buffer &state,
+    const cl::buffer &diffs, const cl::event &start)
+{
+  // In place sweeps only ever touch state, otherwise even sweeps go from
+  // state to the scratch buffer and odd sweeps back again.
+  const bool in_place = defaults::get().solver() == defaults::JACOBI_INPLACE;
+  cl::buffer scratch = in_place ? state : env.lattice_buffer();
+
+  // Blocked and vectorized sweeps only make sense between two buffers
+  const bool strips = !in_place && defaults::get().vectorize();
+  const unsigned block_sweeps =
+    in_place || strips ? 1 : env.params.block_sweeps;
+  std::vector<cl::nd_run> runs;
+  if(strips) {
+    runs.push_back(make_strip_run(env, state, scratch, diffs));
+    runs.push_back(make_strip_run(env, scratch, state, diffs));
+  } else {
+    runs.push_back(make_jacobi_run(env, state, scratch, diffs, block_sweeps));
+    runs.push_back(make_jacobi_run(env, scratch, state, diffs, block_sweeps));
+  }
+  jacobi_sweeper sweeps(runs, block_sweeps);
+
+  // The lattices of a batch are reduced together, so a batch has converged
+  // once its slowest problem has.
+  residual_monitor residual(env, diffs,
+      env.params.global_dims[0], env.params.global_row_stride,
+      env.params.global_dims[1]*env.problems.size(),
+      defaults::get().local_size().dim[0]*defaults::get().local_size().dim[1]);
+
+  solve_result result(state);
+  iterate(env, sweeps, residual, start, defaults::get().check_interval(),
+      result);
+  if(result.iterations/block_sweeps % 2) {
+    result.state = scratch;
+  }
+
+  return result;
+}
@@ -0,0 +1,17 @@
+#ifndef KERNELS_HH_INCLUDED
+#define KERNELS_HH_INCLUDED
+
+#include <cstddef>
+
+/* Kernel source and precompiled SPIR-V modules of the generic (unspecialized)
+ * kernels, embedded into the executable by embed.cmake. Modules the build
+ * could not produce have size 0.
+ */
+extern const unsigned char laplace_jac_cl[];
+extern const std::size_t laplace_jac_cl_size;
+extern const unsigned char laplace_jac_float_spv[];
+extern const std::size_t laplace_jac_float_spv_size;
+extern const unsigned char laplace_jac_double_spv[];
+extern const std::size_t laplace_jac_double_spv_size;
+
+#endif /* KERNELS_HH_INCLUDED */
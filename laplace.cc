@@ -1,17 +1,16 @@
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <iostream>
 #include <fstream>
-#include <boost/timer.hpp>
+#include <future>
+#include <iomanip>
+#include <sstream>
 #include "clpp/clpp.hh"
 #include "laplace.hh"
 #include "defaults.hh"
-
-// Obtain standard sized integers
-#include <stdint.h>
-
-// Grab the param_t structure
-#define HOST_INCLUSION
-#include "laplace_jac.cl"
+#include "kernels.hh"
+#include "solver.hh"
 
 help_activated::help_activated(void)
   : runtime_error("help activated")
@@ -33,20 +32,30 @@ cl::platform select_platform(void)
   return platform;
 }
 
-cl::device select_device(cl::platform platform)
+std::vector<cl::device> select_devices(cl::platform platform)
 {
   cl::device::type dtype = defaults::get().dev_type();
   std::vector<cl::device> devices(cl::device::get_devices(platform, dtype));
-  if(devices.size() == 0) {
+  if(devices.empty()) {
     throw std::runtime_error("no available devices");
   }
-  /* For now, just pick the first device */
-  cl::device device = devices[0];
+  if(defaults::get().numa()) {
+    /* One sub-device per NUMA domain of the first device */
+    devices = devices.front().partition_numa();
+  } else {
+    if(devices.size() < defaults::get().device_count()) {
+      throw std::runtime_error("not enough available devices");
+    }
+    /* For now, just pick the first devices */
+    devices.resize(defaults::get().device_count(), devices.front());
+  }
   if(defaults::get().verbose()) {
-    std::cerr << "Selected device '" << device.name() << "' driver version " <<
-      device.driver_version() << std::endl;
+    for(std::size_t i = 0; i < devices.size(); ++i) {
+      std::cerr << "Selected device '" << devices[i].name() <<
+        "' driver version " << devices[i].driver_version() << std::endl;
+    }
   }
-  return device;
+  return devices;
 }
 
 params_t make_params(void)
@@ -55,16 +64,144 @@ params_t make_params(void)
   
   ret.global_dims[0] = defaults::get().lattice_size().dim[0];
   ret.global_dims[1] = defaults::get().lattice_size().dim[1];
-  ret.global_row_stride = defaults::get().lattice_size().dim[0];
+  ret.global_row_stride = padded_row_stride(ret.global_dims[0]);
   ret.xmin = ret.ymin = 0.0f;
   ret.xmax = ret.ymax = M_PI;
+  ret.omega = sor_omega(ret);
+  ret.block_sweeps = defaults::get().block_sweeps();
+  ret.bc_left = ret.bc_right = ret.bc_top = 1.0f;
+  /* The lattice is evenly spaced */
+  ret.last_dx = (ret.xmax - ret.xmin)/ret.global_dims[0];
+  ret.last_dy = (ret.ymax - ret.ymin)/ret.global_dims[1];
 
   return ret;
 }
 
-void write_data(const params_t &params, const std::vector<float> &dat)
+/* A single problem, or one per line of the batch file */
+std::vector<params_t> make_problems(void)
+{
+  const params_t base = make_params();
+  const std::string &path = defaults::get().batch_file();
+  if(path.empty()) {
+    return std::vector<params_t>(1, base);
+  }
+
+  std::ifstream fin(path.c_str());
+  if(!fin) {
+    throw std::runtime_error("unable to open batch file " + path);
+  }
+  std::vector<params_t> ret;
+  std::string line;
+  while(std::getline(fin, line)) {
+    // Skip blank lines and comments
+    const std::string::size_type first = line.find_first_not_of(" \t");
+    if(first == std::string::npos || line[first] == '#') {
+      continue;
+    }
+    std::istringstream fields(line);
+    params_t p = base;
+    if(!(fields >> p.bc_left >> p.bc_right >> p.bc_top)) {
+      throw std::runtime_error("malformed line in batch file: " + line);
+    }
+    ret.push_back(p);
+  }
+  if(ret.empty()) {
+    throw std::runtime_error("batch file lists no problems");
+  }
+
+  return ret;
+}
+
+/* Options for building the program: the precision, and unless disabled the
+ * constants of the fine lattice for the Jacobi kernels to fold.
+ */
+std::string build_options(const params_t &params)
+{
+  const bool use_double = defaults::get().double_precision();
+  std::ostringstream opts;
+  opts << (use_double ? "-DREAL_DOUBLE" : "");
+  if(defaults::get().specialize()) {
+    double wx, wy;
+    stencil_weights(params, wx, wy);
+    // Single precision builds want float literals
+    const char *suffix = use_double ? "" : "f";
+    opts << " -DJACOBI_SPECIALIZED" <<
+      " -DSPEC_DIM0=" << params.global_dims[0] <<
+      " -DSPEC_DIM1=" << params.global_dims[1] <<
+      " -DSPEC_STRIDE=" << params.global_row_stride <<
+      " -DSPEC_BLOCK_SWEEPS=" << params.block_sweeps <<
+      " -DSPEC_LOCAL0=" << defaults::get().local_size().dim[0] <<
+      " -DSPEC_LOCAL1=" << defaults::get().local_size().dim[1] <<
+      std::scientific << std::setprecision(17) <<
+      " -DSPEC_WX=" << wx << suffix <<
+      " -DSPEC_WY=" << wy << suffix;
+  }
+
+  return opts.str();
+}
+
+/* Build the embedded kernels. Unspecialized kernels come from the
+ * precompiled SPIR-V module where the build produced one and the device takes
+ * SPIR-V, everything else from the embedded source, through the binary cache
+ * of cache unless that is disabled.
+ */
+cl::program load_program(const cl::context &context,
+    const std::vector<cl::device> &devices, const std::string &options,
+    cl::program_cache &cache)
 {
-  std::ofstream fout("laplace.out");
+  const cl::device &device = devices.front();
+  /* Binaries are cached per device, so shared programs are built here */
+  if(devices.size() > 1) {
+    cl::program program = cl::program::from_memory(context, laplace_jac_cl,
+        laplace_jac_cl_size);
+    program.build(devices, options);
+    return program;
+  }
+
+  const bool use_double = defaults::get().double_precision();
+  const unsigned char *module = use_double ? laplace_jac_double_spv :
+    laplace_jac_float_spv;
+  const std::size_t module_size = use_double ? laplace_jac_double_spv_size :
+    laplace_jac_float_spv_size;
+
+  if(!defaults::get().specialize() && module_size > 0 &&
+      device.il_version().find("SPIR-V") != std::string::npos) {
+    if(defaults::get().verbose()) {
+      std::cerr << "Using precompiled SPIR-V kernels" << std::endl;
+    }
+    cl::program program = cl::program::from_il(context, module, module_size);
+    program.build(device);
+    return program;
+  }
+
+  if(!defaults::get().program_cache()) {
+    cl::program program = cl::program::from_memory(context, laplace_jac_cl,
+        laplace_jac_cl_size);
+    program.build(device, options);
+    return program;
+  }
+
+  const std::string source(reinterpret_cast<const char *>(laplace_jac_cl),
+      laplace_jac_cl_size);
+
+  bool cached = false;
+  cl::program program = cache.build_source(context, device, source, options,
+      &cached);
+  if(cached && defaults::get().verbose()) {
+    std::cerr << "Loaded program binary from " << cache.default_directory() <<
+      std::endl;
+  }
+  return program;
+}
+
+/* Lattice values are taken from the lattice at dat with rows stride values
+ * apart, and written as float whatever the precision of the solve.
+ */
+template<typename real_t>
+void write_data(const std::string &filename, const params_t &params,
+    const real_t *dat, std::size_t stride)
+{
+  std::ofstream fout(filename.c_str());
   std::vector<float> output;
   output.reserve(params.global_dims[1] + 1);
   // Write data in the binary format supported by gnuplot. Note the stupid
@@ -91,13 +228,153 @@ void write_data(const params_t &params, const std::vector<float> &dat)
         (params.xmax - params.xmin));
 
     for(unsigned r = 0; r < params.global_dims[1]; ++r) {
-      output.push_back(dat.at(r*params.global_row_stride + c));
+      output.push_back(static_cast<float>(
+            dat[r*stride + c]));
     }
 
     fout.write((char *)(&output[0]), output.size()*sizeof(output[0]));
   }
 }
 
+/* Output file of problem i of a batch of count problems */
+std::string output_name(std::size_t count, std::size_t i)
+{
+  if(count == 1) {
+    return "laplace.out";
+  }
+
+  std::ostringstream name;
+  name << "laplace-" << i << ".out";
+  return name.str();
+}
+
+/* Initialize, solve and write out the lattice with values of type real_t,
+ * which has to match the real_t the program was built with, on queues, one
+ * per device. Kernels come from cache and buffers from pool, so repeated runs
+ * reuse both. prof, if given, is the profiler attached to the queues and gets
+ * reported along with the run.
+ */
+template<typename real_t>
+void run(const cl::context &context, const std::vector<cl::queue> &queues,
+    const cl::program &program, cl::program_cache &cache,
+    cl::buffer_pool &pool, const std::vector<params_t> &problems,
+    cl::profiler *prof)
+{
+  solver_env env(context, queues, program, cache, pool, problems,
+      sizeof(real_t));
+  const params_t &param_val = env.params;
+
+  cl::kernel init_kernel = env.get_kernel("init_domain");
+  init_kernel.argv()[0] <<= env.params_buf;
+  cl::buffer state = env.lattice_buffer();
+  init_kernel.argv()[1] <<= state;
+  cl::buffer diffs = env.lattice_buffer();
+  init_kernel.argv()[2] <<= diffs;
+  // Setup kernel execution and initialize state (on device)
+  cl::nd_run run_init(batch_run(env, init_kernel,
+        defaults::get().global_size().dim, defaults::get().local_size().dim));
+  cl::event ev = env.queue.add(run_init);
+  ev.wait();
+  if(defaults::get().verbose()) {
+    std::cerr << "Initialization finished, started timing" << std::endl;
+  }
+  if(prof) {
+    prof->reset();
+  }
+  const std::chrono::steady_clock::time_point started =
+    std::chrono::steady_clock::now();
+  solve_result result(state);
+  switch(defaults::get().solver()) {
+    case defaults::SOR:
+      if(defaults::get().verbose()) {
+        std::cerr << "Relaxation factor " << param_val.omega << std::endl;
+      }
+      result = solve_sor(env, state, ev);
+      break;
+    case defaults::MULTIGRID:
+      result = solve_multigrid(env, state, ev);
+      break;
+    case defaults::CG:
+      result = solve_cg(env, state, ev);
+      break;
+    case defaults::BANDS:
+      result = solve_bands(env, state, ev);
+      break;
+    default:
+      result = solve_jacobi(env, state, diffs, ev);
+      break;
+  }
+  const double elapsed = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - started).count();
+  if(defaults::get().verbose()) {
+    std::cerr << "Run finished after " << result.iterations <<
+      " iterations (" << (result.converged ? "converged" : "not converged") <<
+      "), elapsed time: " << elapsed << std::endl;
+    std::cerr << "Final L2 residual " << result.l2 << ", max residual " <<
+      result.linf << std::endl;
+  }
+  if(prof) {
+    /* Whatever the busiest queue did not spend executing commands went to
+     * the host and to gaps between commands. Commands overlap on out-of-order
+     * queues and run side by side on several queues, so the busy time of a
+     * queue counts overlapping commands once and queues are not added up.
+     */
+    const std::vector<cl::profiler::summary> sums = prof->collect();
+    double total = 0, queued = 0;
+    for(std::size_t i = 0; i < sums.size(); ++i) {
+      total += sums[i].total;
+      queued += sums[i].latency;
+    }
+    const std::vector<double> busy_times = prof->busy_times();
+    double busy = 0;
+    for(std::size_t i = 0; i < busy_times.size(); ++i) {
+      busy = std::max(busy, busy_times[i]);
+    }
+    prof->report(std::cerr);
+    std::cerr << "Time in commands " << total << ", busiest queue " <<
+      busy << ", queueing latency " << queued << ", host overhead " <<
+      elapsed - busy << std::endl;
+  }
+
+  if(defaults::get().lattice_memory() != cl::mem::MEM_HOST_NONE) {
+    // Lattices in host memory are written out in place
+    cl::buffer_map mapped(env.queue, result.state,
+        cl::buffer_map::MAP_READ, env.lattice_bytes());
+    mapped.ready().wait();
+    const real_t *lattices = static_cast<const real_t *>(mapped.data());
+    for(std::size_t i = 0; i < problems.size(); ++i) {
+      write_data(output_name(problems.size(), i), problems[i],
+          lattices + i*env.cells(), param_val.global_row_stride);
+    }
+    /* The buffer goes back to the pool, the next solve may reuse it */
+    mapped.unmap().wait();
+    return;
+  }
+
+  // Read back one problem at a time, so the files of a batch are written
+  // while the later problems are still being read. The row padding stays on
+  // the device.
+  const std::size_t width = param_val.global_dims[0];
+  const std::size_t rows = param_val.global_dims[1];
+  const cl::rect_extent lattice(width*sizeof(real_t), rows);
+  std::vector<real_t> data(width*rows*problems.size());
+  std::vector<std::future<void> > read(problems.size());
+  for(std::size_t i = 0; i < problems.size(); ++i) {
+    read[i] = env.queue.add(cl::buffer_read_rect(result.state,
+          cl::rect_origin(0, i*rows,
+            param_val.global_row_stride*sizeof(real_t)),
+          &data[i*width*rows], cl::rect_origin(0, 0, width*sizeof(real_t)),
+          lattice)).future();
+  }
+  env.queue.flush();
+
+  for(std::size_t i = 0; i < problems.size(); ++i) {
+    read[i].get();
+    write_data(output_name(problems.size(), i), problems[i],
+        &data[i*width*rows], width);
+  }
+}
+
 int main(int argc, char **argv)
 try {
   defaults::process_arguments(argc, argv);
@@ -105,72 +382,75 @@ try {
   if(defaults::get().verbose()) {
     std::cerr << "Selected device type '" << defaults::get().dev_type() <<
       '\'' << std::endl;
+    std::cerr << "Selected solver '" << defaults::get().solver() << '\'' <<
+      std::endl;
   }
 
   /* Setup params */
-  params_t param_val = make_params();
-  /* Allocate space to recieve state back (for printing) */
-  std::vector<float> data(param_val.global_row_stride*param_val.global_dims[1]);
+  const std::vector<params_t> problems = make_problems();
+  if(defaults::get().verbose()) {
+    std::cerr << "Lattice " << defaults::get().lattice_size() <<
+      ", row stride " << problems.front().global_row_stride <<
+      ", work groups of " << defaults::get().local_size() << ", " <<
+      problems.size() << " problem(s)" << std::endl;
+  }
 
   cl::platform platform = select_platform();
-  cl::device device = select_device(platform);
-  cl::context context = cl::context::create(device);
-  cl::queue queue = cl::queue::create(context, device);
-  cl::program program = cl::program::from_source(context, "laplace_jac.cl");
-  cl::program::build_info build = program.build(device);
-
-  if(!build) {
-    std::cerr << "Build failed, log follows:" << std::endl;
-  } else if(defaults::get().verbose()) {
-    std::cerr << "Build succeeded, log follows:" << std::endl;
-  }
-  if(!build || defaults::get().verbose()) {
-    std::cerr << build.build_log() << std::endl;
-  }
-
-  cl::kernel init_kernel = program.get_kernel("init_domain");
-  cl::kernel jac_kernel = program.get_kernel("jacobi_step");
-  cl::buffer params = cl::buffer::create(context, sizeof(params_t), cl::mem::MEM_MODE_RO);
-  queue.add(cl::buffer_write(params, &param_val, sizeof(param_val)));
-  init_kernel.argv()[0] <<= params;
-  jac_kernel.argv()[0] <<= params;
-  cl::buffer state = cl::buffer::create(context,
-      defaults::get().lattice_size().dim[1]*param_val.global_row_stride*sizeof(float));
-  init_kernel.argv()[1] <<= state;
-  jac_kernel.argv()[1] <<= state;
-  cl::buffer diffs = cl::buffer::create(context,
-      defaults::get().lattice_size().dim[1]*param_val.global_row_stride*sizeof(float));
-  init_kernel.argv()[2] <<= diffs;
-  jac_kernel.argv()[2] <<= diffs;
-  // Figure out local space req'd (two additional rows and columns) and add
-  // local space to the jacobian kernel.
-  jac_kernel.argv()[3] <<= cl::local_space(sizeof(float)*
-      (defaults::get().local_size().dim[0] + 2)*
-      (defaults::get().local_size().dim[1] + 2));
-  // Setup kernel execution and initialize state (on device)
-  cl::nd_run run_init(init_kernel, defaults::get().lattice_size().dim,
-      defaults::get().local_size().dim);
-  cl::nd_run run_jacobi(jac_kernel, defaults::get().lattice_size().dim,
-      defaults::get().local_size().dim);
-  cl::event ev = queue.add(run_init);
-  ev.wait();
-  if(defaults::get().verbose()) {
-    std::cerr << "Initialization finished, started timing" << std::endl;
+  const std::vector<cl::device> devices = select_devices(platform);
+  const bool use_double = defaults::get().double_precision();
+  for(std::size_t i = 0; i < devices.size(); ++i) {
+    if(use_double && !devices[i].has_extension("cl_khr_fp64")) {
+      throw std::runtime_error("device does not support double precision");
+    }
   }
-  boost::timer runtime;
-  for(int i = 0; i < 10000; ++i) {
-    ev = queue.add(run_jacobi, std::vector<cl::event>(1,ev));
+  /* All devices share one context, so buffers and the program exist once */
+  cl::context context = cl::context::create(devices);
+  /* The verbose report includes a profile of the commands */
+  cl::profiler profile;
+  std::vector<cl::queue> queues = cl::queue::create_all(context,
+      (defaults::get().in_order() ? cl::queue::QUEUE_IN_ORDER :
+       cl::queue::QUEUE_OUT_OF_ORDER) |
+      (defaults::get().verbose() ? cl::queue::QUEUE_PROFILING : 0));
+  cl::profiler *prof = 0;
+  if(defaults::get().verbose()) {
+    prof = &profile;
+    for(std::size_t i = 0; i < queues.size(); ++i) {
+      queues[i].set_profiler(prof);
+    }
   }
-  ev.wait();
+  const std::string options = build_options(problems.front());
   if(defaults::get().verbose()) {
-    std::cerr << "Run finished, elapsed time: " << runtime.elapsed() << std::endl;
+    std::cerr << "Build options '" << options << '\'' << std::endl;
   }
+  /* Binaries on disk, and the kernels of all repeats in memory */
+  cl::program_cache cache;
+  cl::program program = load_program(context, devices, options, cache);
 
-  // Setup to recieve state back from the device
-  queue.add(cl::buffer_read(state, &data[0], data.size()*sizeof(data[0]))).wait();
+  for(std::size_t i = 0; i < devices.size(); ++i) {
+    cl::program::build_info build(program, devices[i]);
+    if(!build) {
+      std::cerr << "Build failed, log follows:" << std::endl;
+    } else if(defaults::get().verbose()) {
+      std::cerr << "Build succeeded, log follows:" << std::endl;
+    }
+    if(!build || defaults::get().verbose()) {
+      std::cerr << build.build_log() << std::endl;
+    }
+  }
 
-  // Write data back to file
-  write_data(param_val, data);
+  /* Repeated solves get their buffers back from the pool */
+  cl::buffer_pool pool(context,
+      static_cast<std::size_t>(defaults::get().pool_limit())*1024*1024);
+  for(unsigned i = 0; i < defaults::get().repeats(); ++i) {
+    if(use_double) {
+      run<double>(context, queues, program, cache, pool, problems, prof);
+    } else {
+      run<float>(context, queues, program, cache, pool, problems, prof);
+    }
+  }
+  if(defaults::get().verbose()) {
+    pool.report(std::cerr);
+  }
 
   return 0;
 } catch(help_activated &help) {
@@ -1,3 +1,6 @@
+#ifndef LAPLACE_JAC_CL_INCLUDED
+#define LAPLACE_JAC_CL_INCLUDED
+
 /* Define matching types for parameters on each side */
 #ifdef HOST_INCLUSION
 #define pval_uint_t uint32_t
@@ -9,27 +12,77 @@ typedef struct {
   pval_uint_t global_dims[2];
   pval_uint_t global_row_stride;
   float xmin, xmax, ymin, ymax;
+  /* Over-relaxation factor of the red-black SOR solver */
+  float omega;
+  /* Jacobi sweeps done per launch by jacobi_block_step */
+  pval_uint_t block_sweeps;
+  /* Amplitudes of the left, right and top boundary profiles */
+  float bc_left, bc_right, bc_top;
+  /* Width of the last column and row interval, which only coarse multigrid
+   * levels make narrower than the others
+   */
+  float last_dx, last_dy;
 } params_t;
 
+/* Rows updated by each work item of jacobi_strip_step */
+#define JACOBI_STRIP_ROWS 8
+
 #ifndef HOST_INCLUSION
+/* Precision of the lattice values, chosen when the program is built. Defining
+ * REAL_DOUBLE needs cl_khr_fp64. The geometry in params_t and the residual
+ * norms read back by the host stay single precision.
+ */
+#ifdef REAL_DOUBLE
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real_t;
+typedef double2 real2_t;
+typedef double4 real4_t;
+/* select() on real4_t takes a mask of the same width */
+#define convert_real4_mask convert_long4
+#else
+typedef float real_t;
+typedef float2 real2_t;
+typedef float4 real4_t;
+#define convert_real4_mask convert_int4
+#endif
+
+/* Batched runs stack one lattice per problem in each buffer and pass one
+ * params_t per problem, the problem being picked by the third dimension of the
+ * range. Unbatched runs have a two dimensional range and only see problem 0.
+ * Offset of the lattice of this work item's problem:
+ */
+uint batch_offset(constant params_t *params)
+{
+  return get_global_id(2)*params->global_row_stride*params->global_dims[1];
+}
+
 kernel void init_domain(constant params_t *params,
-                        global float *output,
-                        global float *diffs)
+                        global real_t *output,
+                        global real_t *diffs)
 {
-  const float PI = 4.0f*atan(1.0f);
+  const real_t PI = 4*atan((real_t)1);
+  params += get_global_id(2);
+  output += batch_offset(params);
+  diffs += batch_offset(params);
+  const uint dim0 = params->global_dims[0], dim1 = params->global_dims[1];
+
+  /* The range is rounded up to whole work groups */
+  if(get_global_id(0) >= dim0 || get_global_id(1) >= dim1) {
+    return;
+  }
 
   /* Compute the output position for this work item */
   uint opos = get_global_id(0) + params->global_row_stride*get_global_id(1);
-  float x = params->xmin + (params->xmax - params->xmin)*
-    convert_float(get_global_id(0))/convert_float(get_global_size(0));
-  float y = params->ymin + (params->ymax - params->ymin)*get_global_id(1)/
-    get_global_size(1);
+  real_t x = params->xmin + (real_t)(params->xmax - params->xmin)*
+    get_global_id(0)/dim0;
+  real_t y = params->ymin + (real_t)(params->ymax - params->ymin)*
+    get_global_id(1)/dim1;
 
   /* Handle boundary conditions and initialize the interior to zero */
-  float oval = 0;
-  oval = select(oval, sin(2*y), get_global_id(0) == 0);
-  oval = select(oval, sin(y/2), get_global_id(0) == get_global_size(0) - 1);
-  oval = select(oval, x/PI, get_global_id(1) == get_global_size(1) - 1);
+  real_t oval = 0;
+  oval = get_global_id(0) == 0 ? params->bc_left*sin(2*y) : oval;
+  oval = get_global_id(0) == dim0 - 1 ? params->bc_right*sin(y/2) : oval;
+  oval = get_global_id(1) == dim1 - 1 ? params->bc_top*x/PI : oval;
 
   output[opos] = oval;
 
@@ -37,45 +90,107 @@ kernel void init_domain(constant params_t *params,
   diffs[opos] = 0;
 }
 
-kernel void jacobi_step(constant params_t *params,
-                          global float *state,
-                          global float *diffs,
-                          local float *ltile)
+/* Weights of the horizontal and vertical neighbours in the five point
+ * stencil, they add up to one half.
+ */
+void stencil_weights(params_t params, real_t *wx, real_t *wy)
 {
+  const real_t dx =
+    (real_t)(params.xmax - params.xmin)/params.global_dims[0];
+  const real_t dy =
+    (real_t)(params.ymax - params.ymin)/params.global_dims[1];
+
+  *wx = dy*dy/(2*(dx*dx + dy*dy));
+  *wy = dx*dx/(2*(dx*dx + dy*dy));
+}
+
+/* The Jacobi kernels only ever sweep the fine lattice, whose constants the
+ * host may build into the program by defining JACOBI_SPECIALIZED together
+ * with SPEC_DIM0, SPEC_DIM1, SPEC_STRIDE, SPEC_BLOCK_SWEEPS, SPEC_WX, SPEC_WY,
+ * SPEC_LOCAL0 and SPEC_LOCAL1, so that the compiler can fold the lattice
+ * geometry. Otherwise they are read from params and the work group size at
+ * run time.
+ */
+#ifdef JACOBI_SPECIALIZED
+#define JACOBI_DIM0(p) SPEC_DIM0
+#define JACOBI_DIM1(p) SPEC_DIM1
+#define JACOBI_STRIDE(p) SPEC_STRIDE
+#define JACOBI_HALO(p) SPEC_BLOCK_SWEEPS
+#define JACOBI_WEIGHTS(p, wx, wy) (*(wx) = SPEC_WX, *(wy) = SPEC_WY)
+#define JACOBI_LOCAL0 SPEC_LOCAL0
+#define JACOBI_LOCAL1 SPEC_LOCAL1
+/* For the kernels run with the lattice work group size */
+#define JACOBI_GROUP_SIZE \
+  __attribute__((reqd_work_group_size(SPEC_LOCAL0, SPEC_LOCAL1, 1)))
+#else
+#define JACOBI_DIM0(p) ((p)->global_dims[0])
+#define JACOBI_DIM1(p) ((p)->global_dims[1])
+#define JACOBI_STRIDE(p) ((p)->global_row_stride)
+#define JACOBI_HALO(p) ((p)->block_sweeps)
+#define JACOBI_WEIGHTS(p, wx, wy) stencil_weights(*(p), wx, wy)
+#define JACOBI_LOCAL0 get_local_size(0)
+#define JACOBI_LOCAL1 get_local_size(1)
+#define JACOBI_GROUP_SIZE
+#endif
+
+/* One Jacobi sweep from input into output. Binding the same buffer to both
+ * gives the old in-place update, in which work groups race on their halos.
+ * The range may be rounded up to whole work groups, the tiles of the last
+ * groups in each direction are then clipped to the lattice.
+ */
+kernel JACOBI_GROUP_SIZE void jacobi_step(constant params_t *params,
+                          global const real_t *input,
+                          global real_t *output,
+                          global real_t *diffs,
+                          local real_t *ltile)
+{
+  params += get_global_id(2);
+  input += batch_offset(params);
+  output += batch_offset(params);
+  diffs += batch_offset(params);
+
   /* Local tile row stride */
-  const uint lt_row_stride = get_local_size(0) + 2;
+  const uint lt_row_stride = JACOBI_LOCAL0 + 2;
   /* Compute the location of our element within the local tile */
   const uint ltpos = 1 + get_local_id(0) + (1 + get_local_id(1))*lt_row_stride;
 
+  const uint dim0 = JACOBI_DIM0(params), dim1 = JACOBI_DIM1(params);
+  const uint stride = JACOBI_STRIDE(params);
+  /* Lower left corner of this work group in the lattice */
+  const uint gx0 = get_group_id(0)*JACOBI_LOCAL0;
+  const uint gy0 = get_group_id(1)*JACOBI_LOCAL1;
+  /* Part of the work group which lies inside the lattice */
+  const uint tile_width = min((uint)JACOBI_LOCAL0, dim0 - gx0);
+  const uint tile_height = min((uint)JACOBI_LOCAL1, dim1 - gy0);
+
   /* Length of row to read from the global space */
-  const uint row_read_len = get_local_size(0) +
+  const uint row_read_len = tile_width +
     /* Add one if there's a column to the left */
-    (get_group_id(0) > 0) +
+    (gx0 > 0) +
     /* Add one if there's a column to the right */
-    (get_group_id(0) < get_num_groups(0) - 1);
+    (gx0 + tile_width < dim0);
 
   /* Number of rows to read */
-  const uint row_read_count = get_local_size(1) +
+  const uint row_read_count = tile_height +
     /* Add one if there's a row beneath us */
-    (get_group_id(1) > 0) +
+    (gy0 > 0) +
     /* Add one if there's a row above us */
-    (get_group_id(1) < get_num_groups(1) - 1);
+    (gy0 + tile_height < dim1);
 
   /* Position the read window. First compute the position of this work group's
    * lower left corner in the global array
    */
-  const uint wgpos = get_group_id(0)*get_local_size(0) +
-    get_group_id(1)*get_local_size(1)*params->global_row_stride;
+  const uint wgpos = gx0 + gy0*stride;
   /* Compute the position of the window from which we read the local tile.
    */
-  global float *global_pos = state + wgpos -
+  global const real_t *global_pos = input + wgpos -
     /* Move one unit back if there's a column to the left we need to read */
     (get_group_id(0) > 0) -
     /* And move down a row if we need to include that one */
-    (get_group_id(1) > 0)*params->global_row_stride;
+    (get_group_id(1) > 0)*stride;
 
   /* Location to start reading into the tile */
-  local float *local_pos = ltile + (get_group_id(0) == 0) +
+  local real_t *local_pos = ltile + (get_group_id(0) == 0) +
     (get_group_id(1) == 0)*lt_row_stride;
 
   /* Collective read of local tile */
@@ -84,7 +199,7 @@ kernel void jacobi_step(constant params_t *params,
     copy_complete = async_work_group_copy(
       local_pos, global_pos, row_read_len, copy_complete);
     local_pos += lt_row_stride;
-    global_pos += params->global_row_stride;
+    global_pos += stride;
   }
   wait_group_events(1, &copy_complete);
 
@@ -92,40 +207,811 @@ kernel void jacobi_step(constant params_t *params,
    * boundaries.
    */
   bool edge = get_global_id(0) == 0 ||
-              get_global_id(0) == get_global_size(0) - 1 ||
+              get_global_id(0) >= dim0 - 1 ||
               get_global_id(1) == 0 ||
-              get_global_id(1) == get_global_size(1) - 1;
+              get_global_id(1) >= dim1 - 1;
+  const bool inside = get_global_id(0) < dim0 && get_global_id(1) < dim1;
 
-  /* Two different cases based on stability */
-  const float dx = (params->xmax - params->xmin)/get_global_size(0);
-  const float dy = (params->ymax - params->ymin)/get_global_size(1);
-  const float lambda2 = pow(dx/dy,2)*isless(dx,dy) +
-                        pow(dy/dx,2)*isgreaterequal(dx,dy);
-  const uint idx1 = ltpos - lt_row_stride*isless(dx,dy) - isgreaterequal(dx,dy);
-  const uint idx2 = ltpos + lt_row_stride*isless(dx,dy) + isgreaterequal(dx,dy);
-  const uint idx3 = ltpos - isless(dx,dy) - lt_row_stride*isgreaterequal(dx,dy);
-  const uint idx4 = ltpos + isless(dx,dy) + lt_row_stride*isgreaterequal(dx,dy);
+  /* Weighted average of the horizontal and vertical neighbours */
+  real_t wx, wy;
+  JACOBI_WEIGHTS(params, &wx, &wy);
+  real_t updval = wx*(ltile[ltpos - 1] + ltile[ltpos + 1]) +
+    wy*(ltile[ltpos - lt_row_stride] + ltile[ltpos + lt_row_stride]);
 
-  float updval = ltile[idx1] + ltile[idx2];
-  updval *= lambda2;
-  updval += ltile[idx3] + ltile[idx4];
-  updval /= 2*(1 + lambda2);
+  /* Record the change made to this cell for the convergence check, the
+   * boundaries never change.
+   */
+  if(inside) {
+    diffs[get_global_id(0) + stride*get_global_id(1)] =
+      edge ? 0 : updval - ltile[ltpos];
+  }
 
-  ltile[ltpos] = select(updval, ltile[ltpos], edge);
+  /* Every neighbour has to be read before any cell of the tile is replaced */
+  updval = edge ? ltile[ltpos] : updval;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  ltile[ltpos] = updval;
 
   /* Collective output of local tile */
   barrier(CLK_LOCAL_MEM_FENCE);
   copy_complete = 0;
-  global_pos = state + wgpos;
+  global real_t *output_pos = output + wgpos;
   local_pos = ltile + 1 + lt_row_stride;
-  for(int r = 0; r < get_local_size(1); ++r) {
+  for(int r = 0; r < tile_height; ++r) {
     copy_complete = async_work_group_copy(
-      global_pos, local_pos, get_local_size(0), copy_complete);
+      output_pos, local_pos, tile_width, copy_complete);
     local_pos += lt_row_stride;
-    global_pos += params->global_row_stride;
+    output_pos += stride;
   }
   wait_group_events(1, &copy_complete);
 }
+
+/* Several Jacobi sweeps from input into output in a single launch. Each work
+ * group loads its tile with a halo of block_sweeps cells into local memory
+ * and sweeps it block_sweeps times, the valid part of the tile shrinking by
+ * one cell per sweep, so that only the interior is left to write back. ltile
+ * has to hold two tiles of (local size + 2*block_sweeps)^2 values.
+ */
+kernel JACOBI_GROUP_SIZE void jacobi_block_step(constant params_t *params,
+                              global const real_t *input,
+                              global real_t *output,
+                              global real_t *diffs,
+                              local real_t *ltile)
+{
+  params += get_global_id(2);
+  input += batch_offset(params);
+  output += batch_offset(params);
+  diffs += batch_offset(params);
+
+  const int halo = JACOBI_HALO(params);
+  const int ext0 = JACOBI_LOCAL0 + 2*halo;
+  const int ext1 = JACOBI_LOCAL1 + 2*halo;
+  const int tile_size = ext0*ext1;
+  const int lid = get_local_id(0) + get_local_id(1)*JACOBI_LOCAL0;
+  const int lsize = JACOBI_LOCAL0*JACOBI_LOCAL1;
+  const int dim0 = JACOBI_DIM0(params), dim1 = JACOBI_DIM1(params);
+  const uint stride = JACOBI_STRIDE(params);
+
+  /* Global position of the tile's lower left corner */
+  const int ox = (int)(get_group_id(0)*JACOBI_LOCAL0) - halo;
+  const int oy = (int)(get_group_id(1)*JACOBI_LOCAL1) - halo;
+
+  local real_t *cur = ltile, *next = ltile + tile_size;
+
+  for(int i = lid; i < tile_size; i += lsize) {
+    const int gx = ox + i%ext0, gy = oy + i/ext0;
+    cur[i] = (gx >= 0 && gx < dim0 && gy >= 0 && gy < dim1) ?
+      input[gx + gy*stride] : 0.0f;
+  }
+  barrier(CLK_LOCAL_MEM_FENCE);
+
+  real_t wx, wy;
+  JACOBI_WEIGHTS(params, &wx, &wy);
+
+  for(int sweep = 1; sweep <= halo; ++sweep) {
+    for(int i = lid; i < tile_size; i += lsize) {
+      const int tx = i%ext0, ty = i/ext0;
+      const int gx = ox + tx, gy = oy + ty;
+      /* Cells outside the part of the tile that is still valid, and the
+       * boundaries of the lattice, just carry their value over.
+       */
+      const bool update = tx >= sweep && tx < ext0 - sweep &&
+                          ty >= sweep && ty < ext1 - sweep &&
+                          gx > 0 && gx < dim0 - 1 && gy > 0 && gy < dim1 - 1;
+      next[i] = update ?
+        wx*(cur[i - 1] + cur[i + 1]) + wy*(cur[i - ext0] + cur[i + ext0]) :
+        cur[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+    local real_t *done = cur;
+    cur = next;
+    next = done;
+  }
+
+  /* cur now holds the last sweep and next the one before */
+  const int gx = get_global_id(0), gy = get_global_id(1);
+  if(gx < dim0 && gy < dim1) {
+    const int i = halo + get_local_id(0) + (halo + get_local_id(1))*ext0;
+    output[gx + gy*stride] = cur[i];
+    diffs[gx + gy*stride] = cur[i] - next[i];
+  }
+}
+
+/* One Jacobi sweep from input into output, each work item updating a strip of
+ * four columns by JACOBI_STRIP_ROWS rows with vector loads and stores. The
+ * rows below, at and above the current one stay in registers as the strip is
+ * walked upwards. Run over (dims[0]/4, dims[1]/JACOBI_STRIP_ROWS), rounded
+ * up; the row stride has to be a multiple of four.
+ */
+kernel void jacobi_strip_step(constant params_t *params,
+                              global const real_t *input,
+                              global real_t *output,
+                              global real_t *diffs)
+{
+  params += get_global_id(2);
+  input += batch_offset(params);
+  output += batch_offset(params);
+  diffs += batch_offset(params);
+
+  const uint stride = JACOBI_STRIDE(params);
+  const uint dim0 = JACOBI_DIM0(params), dim1 = JACOBI_DIM1(params);
+  const uint x0 = 4*get_global_id(0);
+  const uint y0 = JACOBI_STRIP_ROWS*get_global_id(1);
+  if(x0 >= dim0 || y0 >= dim1) {
+    return;
+  }
+  const uint y_end = min(y0 + JACOBI_STRIP_ROWS, dim1);
+
+  real_t wx, wy;
+  JACOBI_WEIGHTS(params, &wx, &wy);
+
+  /* Lanes on the left or right boundary, or in the row padding, keep their
+   * value.
+   */
+  const uint4 xs = (uint4)(x0, x0 + 1, x0 + 2, x0 + 3);
+  const int4 fixed_x = (xs == 0) | (xs >= dim0 - 1);
+
+  real4_t below = y0 > 0 ? vload4(0, input + x0 + (y0 - 1)*stride) :
+    (real4_t)(0);
+  real4_t centre = vload4(0, input + x0 + y0*stride);
+  for(uint y = y0; y < y_end; ++y) {
+    const uint pos = x0 + y*stride;
+    const real4_t above = y + 1 < dim1 ? vload4(0, input + pos + stride) :
+      (real4_t)(0);
+    const real_t left = x0 > 0 ? input[pos - 1] : 0.0f;
+    const real_t right = x0 + 4 < stride ? input[pos + 4] : 0.0f;
+    const real4_t west = (real4_t)(left, centre.s012);
+    const real4_t east = (real4_t)(centre.s123, right);
+
+    const int4 fixed = fixed_x | (int4)(-(y == 0 || y == dim1 - 1));
+    const real4_t updval = select(wx*(west + east) + wy*(below + above),
+        centre, convert_real4_mask(fixed));
+
+    vstore4(updval, 0, output + pos);
+    vstore4(updval - centre, 0, diffs + pos);
+
+    below = centre;
+    centre = above;
+  }
+}
+
+/* One Jacobi sweep of a horizontal band of rows, the lattice rows of the
+ * band being interior rows. The row just below and the row just above the
+ * band come from their own buffers, so the bands of several devices only
+ * share those rows through copies. Work item (x, i) updates row
+ * row0 + i*row_step of the band, which lets the host launch the first and
+ * last rows on their own. These go into edge_low and edge_high as well, for
+ * the neighbouring bands. Run over (width, rows updated), unbatched.
+ */
+kernel void jacobi_band_step(constant params_t *params,
+                             uint rows,
+                             uint row0,
+                             uint row_step,
+                             global const real_t *input,
+                             global const real_t *below,
+                             global const real_t *above,
+                             global real_t *output,
+                             global real_t *diffs,
+                             global real_t *edge_low,
+                             global real_t *edge_high)
+{
+  const uint x = get_global_id(0);
+  const uint y = row0 + get_global_id(1)*row_step;
+  const uint dim0 = params->global_dims[0];
+  if(x >= dim0 || y >= rows) {
+    return;
+  }
+
+  real_t wx, wy;
+  stencil_weights(*params, &wx, &wy);
+
+  const uint stride = params->global_row_stride;
+  const uint pos = x + y*stride;
+  const real_t oldval = input[pos];
+  real_t updval = oldval;
+  /* The left and right boundary columns keep their value */
+  if(x > 0 && x < dim0 - 1) {
+    const real_t south = y > 0 ? input[pos - stride] : below[x];
+    const real_t north = y + 1 < rows ? input[pos + stride] : above[x];
+    updval = wx*(input[pos - 1] + input[pos + 1]) + wy*(south + north);
+  }
+
+  output[pos] = updval;
+  diffs[pos] = updval - oldval;
+  if(y == 0) {
+    edge_low[x] = updval;
+  }
+  if(y == rows - 1) {
+    edge_high[x] = updval;
+  }
+}
+
+/* Red-black SOR keeps each colour in its own compacted array. Cell (x, y) is
+ * red if x + y is even, and lives at x/2 + y*half_stride in the array of its
+ * colour, so a half sweep reads and writes both arrays with unit stride.
+ */
+uint sor_half_stride(constant params_t *params)
+{
+  return (params->global_row_stride + 1)/2;
+}
+
+/* Split the lattice into its red and black halves */
+kernel void sor_split(constant params_t *params,
+                      global const real_t *lattice,
+                      global real_t *red,
+                      global real_t *black)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= params->global_dims[0] || y >= params->global_dims[1]) {
+    return;
+  }
+
+  const uint pos = x/2 + y*sor_half_stride(params);
+  const real_t val = lattice[x + y*params->global_row_stride];
+  if((x + y) & 1) {
+    black[pos] = val;
+  } else {
+    red[pos] = val;
+  }
+}
+
+/* Recombine the red and black halves into the lattice */
+kernel void sor_merge(constant params_t *params,
+                      global const real_t *red,
+                      global const real_t *black,
+                      global real_t *lattice)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= params->global_dims[0] || y >= params->global_dims[1]) {
+    return;
+  }
+
+  const uint pos = x/2 + y*sor_half_stride(params);
+  lattice[x + y*params->global_row_stride] =
+    ((x + y) & 1) ? black[pos] : red[pos];
+}
+
+/* Over-relax every cell of one colour against the cells of the other. Run
+ * over (half stride, rows). The differences of red cells go into the first
+ * half of diffs, those of black cells into the second.
+ */
+void sor_half_step(constant params_t *params,
+                   uint colour,
+                   global real_t *update,
+                   global const real_t *other,
+                   global real_t *diffs)
+{
+  const uint half_stride = sor_half_stride(params);
+  const uint j = get_global_id(0), y = get_global_id(1);
+  if(j >= half_stride || y >= params->global_dims[1]) {
+    return;
+  }
+
+  /* Offset of this colour's first cell in row y. The horizontal neighbours
+   * then sit at j + shift - 1 and j + shift in the other colour's row, the
+   * vertical ones at j in the rows above and below.
+   */
+  const uint shift = (y + colour) & 1;
+  const uint x = 2*j + shift;
+  const uint pos = j + y*half_stride;
+  const bool edge = x == 0 || x >= params->global_dims[0] - 1 ||
+                    y == 0 || y == params->global_dims[1] - 1;
+
+  real_t delta = 0.0f;
+  if(!edge) {
+    real_t wx, wy;
+    stencil_weights(*params, &wx, &wy);
+
+    const real_t jacobi = wx*(other[pos + shift - 1] + other[pos + shift]) +
+      wy*(other[pos - half_stride] + other[pos + half_stride]);
+    delta = params->omega*(jacobi - update[pos]);
+    update[pos] += delta;
+  }
+
+  diffs[pos + colour*half_stride*params->global_dims[1]] = delta;
+}
+
+kernel void sor_red_step(constant params_t *params,
+                         global real_t *red,
+                         global const real_t *black,
+                         global real_t *diffs)
+{
+  sor_half_step(params, 0, red, black, diffs);
+}
+
+kernel void sor_black_step(constant params_t *params,
+                           global real_t *black,
+                           global const real_t *red,
+                           global real_t *diffs)
+{
+  sor_half_step(params, 1, black, red, diffs);
+}
+
+/* Determine if (x, y) lies on the boundary of the lattice */
+bool on_edge(params_t params, uint x, uint y)
+{
+  return x == 0 || x == params.global_dims[0] - 1 ||
+         y == 0 || y == params.global_dims[1] - 1;
+}
+
+/* Weighted sum of the four neighbours of pos, which is the Jacobi update of
+ * an interior cell without source term.
+ */
+real_t stencil_sum(global const real_t *u, uint pos, uint row_stride,
+                  real_t wx, real_t wy)
+{
+  return wx*(u[pos - 1] + u[pos + 1]) +
+         wy*(u[pos - row_stride] + u[pos + row_stride]);
+}
+
+/* Multigrid solves the scaled problem u - mg_stencil_sum(u) = f, so that the
+ * residual on the finest level is exactly the change a Jacobi sweep would
+ * make. Coarse level n has dims/2 + 1 cells per side, with coarse cell i on
+ * top of fine cell 2i, except that the last coarse cell always sits on the
+ * last fine cell. Coarse params keep xmin and ymin and stretch xmax and ymax
+ * so the spacing doubles from level to level, only the last interval of each
+ * direction keeps its true width in last_dx and last_dy. Every level passes
+ * its params by value rather than in a buffer of its own.
+ */
+
+/* Damping of the Jacobi smoother, the best choice for the 2D five point
+ * stencil.
+ */
+#define MG_DAMPING 0.8f
+
+/* Coefficients of the unscaled operator at interior cell (x, y) for its left,
+ * right, lower and upper neighbours. The second difference over uneven
+ * intervals a and b weighs its neighbours 2/(a(a + b)) and 2/(b(a + b)), the
+ * diagonal being their sum.
+ */
+real4_t mg_coefficients(params_t params, uint x, uint y)
+{
+  const real_t dx =
+    (real_t)(params.xmax - params.xmin)/params.global_dims[0];
+  const real_t dy =
+    (real_t)(params.ymax - params.ymin)/params.global_dims[1];
+  const real_t right = x + 2 == params.global_dims[0] ? params.last_dx : dx;
+  const real_t up = y + 2 == params.global_dims[1] ? params.last_dy : dy;
+
+  return (real4_t)(2/(dx*(dx + right)), 2/(right*(dx + right)),
+                   2/(dy*(dy + up)), 2/(up*(dy + up)));
+}
+
+real_t mg_diagonal(real4_t c)
+{
+  return c.s0 + c.s1 + c.s2 + c.s3;
+}
+
+/* stencil_sum with the weights of mg_coefficients, scaled by the diagonal */
+real_t mg_stencil_sum(params_t params, global const real_t *u, uint pos,
+                      uint x, uint y)
+{
+  const uint s = params.global_row_stride;
+  const real4_t c = mg_coefficients(params, x, y);
+
+  return (c.s0*u[pos - 1] + c.s1*u[pos + 1] + c.s2*u[pos - s] +
+          c.s3*u[pos + s])/mg_diagonal(c);
+}
+
+/* Damped Jacobi sweep from input to output */
+kernel void mg_smooth(params_t params,
+                      global const real_t *f,
+                      global const real_t *input,
+                      global real_t *output)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= params.global_dims[0] || y >= params.global_dims[1]) {
+    return;
+  }
+
+  const uint pos = x + y*params.global_row_stride;
+  real_t val = input[pos];
+  if(!on_edge(params, x, y)) {
+    val += MG_DAMPING*(f[pos] + mg_stencil_sum(params, input, pos, x, y) -
+        val);
+  }
+  output[pos] = val;
+}
+
+/* Residual of the scaled problem, zero on the boundary */
+kernel void mg_residual(params_t params,
+                        global const real_t *f,
+                        global const real_t *u,
+                        global real_t *r)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= params.global_dims[0] || y >= params.global_dims[1]) {
+    return;
+  }
+
+  const uint pos = x + y*params.global_row_stride;
+  real_t val = 0.0f;
+  if(!on_edge(params, x, y)) {
+    val = f[pos] + mg_stencil_sum(params, u, pos, x, y) - u[pos];
+  }
+  r[pos] = val;
+}
+
+/* Fine lattice index of coarse index i */
+uint mg_fine_index(uint i, uint fine_dim)
+{
+  return min(2*i, fine_dim - 1);
+}
+
+/* Full weighting restriction of the fine residual r to the coarse right hand
+ * side f. The residuals are those of the scaled problems, so they are taken
+ * back to the unscaled operator on the fine level and scaled again on the
+ * coarse one. Run over the coarse lattice.
+ */
+kernel void mg_restrict(params_t fine,
+                        params_t coarse,
+                        global const real_t *r,
+                        global real_t *f)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= coarse.global_dims[0] || y >= coarse.global_dims[1]) {
+    return;
+  }
+
+  real_t val = 0.0f;
+  if(!on_edge(coarse, x, y)) {
+    const uint s = fine.global_row_stride;
+    const uint fx = mg_fine_index(x, fine.global_dims[0]);
+    const uint fy = mg_fine_index(y, fine.global_dims[1]);
+    /* Weights 4 at the centre, 2 at the sides and 1 at the corners */
+    real_t sum = 0.0f;
+    for(uint j = 0; j < 3; ++j) {
+      for(uint i = 0; i < 3; ++i) {
+        const uint px = fx + i - 1, py = fy + j - 1;
+        sum += (2 - abs((int)i - 1))*(2 - abs((int)j - 1))*
+          mg_diagonal(mg_coefficients(fine, px, py))*r[px + py*s];
+      }
+    }
+    val = sum/(16*mg_diagonal(mg_coefficients(coarse, x, y)));
+  }
+  f[x + y*coarse.global_row_stride] = val;
+}
+
+/* Position of fine cell x between coarse cells x/2 and x/2 + 1, as a fraction
+ * of their distance. h is the fine spacing, last the width of the last coarse
+ * interval.
+ */
+real_t mg_fraction(uint x, real_t h, uint coarse_dim, real_t last)
+{
+  if(!(x & 1)) {
+    return 0.0f;
+  }
+
+  return x/2 + 2 == coarse_dim ? h/last : 0.5f;
+}
+
+/* Bilinear interpolation of coarse lattice c at interior fine cell (x, y) */
+real_t mg_interpolate_at(params_t fine, params_t coarse,
+                         global const real_t *c, uint x, uint y)
+{
+  const uint s = coarse.global_row_stride;
+  const uint i = x/2, j = y/2;
+  const uint i1 = i + (x & 1), j1 = j + (y & 1);
+  const real_t tx = mg_fraction(x,
+      (real_t)(fine.xmax - fine.xmin)/fine.global_dims[0],
+      coarse.global_dims[0], coarse.last_dx);
+  const real_t ty = mg_fraction(y,
+      (real_t)(fine.ymax - fine.ymin)/fine.global_dims[1],
+      coarse.global_dims[1], coarse.last_dy);
+
+  return (1 - ty)*((1 - tx)*c[i + j*s] + tx*c[i1 + j*s]) +
+    ty*((1 - tx)*c[i + j1*s] + tx*c[i1 + j1*s]);
+}
+
+/* Add the interpolated coarse correction c to the fine interior of u. Run over
+ * the fine lattice.
+ */
+kernel void mg_prolong(params_t fine,
+                       params_t coarse,
+                       global const real_t *c,
+                       global real_t *u)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= fine.global_dims[0] || y >= fine.global_dims[1] ||
+      on_edge(fine, x, y)) {
+    return;
+  }
+
+  u[x + y*fine.global_row_stride] +=
+    mg_interpolate_at(fine, coarse, c, x, y);
+}
+
+/* Replace the fine interior of u by the interpolated coarse solution c, used
+ * by full multigrid to start each level. Run over the fine lattice.
+ */
+kernel void mg_interpolate(params_t fine,
+                           params_t coarse,
+                           global const real_t *c,
+                           global real_t *u)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= fine.global_dims[0] || y >= fine.global_dims[1] ||
+      on_edge(fine, x, y)) {
+    return;
+  }
+
+  u[x + y*fine.global_row_stride] =
+    mg_interpolate_at(fine, coarse, c, x, y);
+}
+
+/* Inject the fine lattice u into the coarse lattice c, boundaries included.
+ * Run over the coarse lattice.
+ */
+kernel void mg_inject(params_t fine,
+                      params_t coarse,
+                      global const real_t *u,
+                      global real_t *c)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= coarse.global_dims[0] || y >= coarse.global_dims[1]) {
+    return;
+  }
+
+  c[x + y*coarse.global_row_stride] =
+    u[mg_fine_index(x, fine.global_dims[0]) +
+      mg_fine_index(y, fine.global_dims[1])*fine.global_row_stride];
+}
+
+/* Conjugate gradients for the same scaled problem as multigrid, with the
+ * boundary values moved to the right hand side. Vectors are lattices which
+ * are zero on the boundary, except for u which holds the boundary values.
+ * Lattice kernels are run with the lattice work group size and leave one
+ * partial sum per work group; the matching finish kernel is run as a single
+ * work group of the same shape and keeps its scalars on the device.
+ */
+
+/* Slots in the scalars buffer */
+#define CG_RR 0
+#define CG_PQ 1
+#define CG_ALPHA 2
+#define CG_BETA 3
+
+/* Sum val over the work group, every work item gets the total */
+real_t cg_group_sum(local real_t *scratch, real_t val)
+{
+  const uint lid = get_local_id(0) + get_local_id(1)*get_local_size(0);
+
+  scratch[lid] = val;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for(uint active = get_local_size(0)*get_local_size(1); active > 1; ) {
+    const uint upper = (active + 1)/2;
+    if(lid + upper < active) {
+      scratch[lid] += scratch[lid + upper];
+    }
+    active = upper;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+
+  return scratch[0];
+}
+
+/* Store this work group's share of a dot product */
+void cg_store_partial(global real_t *partial, local real_t *scratch, real_t val)
+{
+  const real_t sum = cg_group_sum(scratch, val);
+  if(get_local_id(0) == 0 && get_local_id(1) == 0) {
+    partial[get_group_id(0) + get_group_id(1)*get_num_groups(0)] = sum;
+  }
+}
+
+/* Total of the partials left by a lattice kernel */
+real_t cg_partial_total(constant params_t *params,
+                       global const real_t *partial,
+                       local real_t *scratch)
+{
+  const uint lid = get_local_id(0) + get_local_id(1)*get_local_size(0);
+  const uint group_count =
+    (params->global_dims[0] + get_local_size(0) - 1)/get_local_size(0)*
+    ((params->global_dims[1] + get_local_size(1) - 1)/get_local_size(1));
+
+  real_t acc = 0.0f;
+  for(uint i = lid; i < group_count;
+      i += get_local_size(0)*get_local_size(1)) {
+    acc += partial[i];
+  }
+
+  return cg_group_sum(scratch, acc);
+}
+
+/* r = p = b - Au for the initial guess u, partial sums of r.r */
+kernel void cg_start(constant params_t *params,
+                     global const real_t *u,
+                     global real_t *r,
+                     global real_t *p,
+                     global real_t *partial,
+                     local real_t *scratch)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  const uint pos = x + y*params->global_row_stride;
+  const bool inside = x < params->global_dims[0] && y < params->global_dims[1];
+
+  real_t val = 0.0f;
+  if(inside && !on_edge(*params, x, y)) {
+    real_t wx, wy;
+    stencil_weights(*params, &wx, &wy);
+    val = stencil_sum(u, pos, params->global_row_stride, wx, wy) - u[pos];
+  }
+  if(inside) {
+    r[pos] = p[pos] = val;
+  }
+
+  cg_store_partial(partial, scratch, val*val);
+}
+
+kernel void cg_start_finish(constant params_t *params,
+                            global const real_t *partial,
+                            global real_t *scalars,
+                            local real_t *scratch)
+{
+  const real_t rr = cg_partial_total(params, partial, scratch);
+  if(get_local_id(0) == 0 && get_local_id(1) == 0) {
+    scalars[CG_RR] = rr;
+  }
+}
+
+/* q = Ap, partial sums of p.q */
+kernel void cg_apply(constant params_t *params,
+                     global const real_t *p,
+                     global real_t *q,
+                     global real_t *partial,
+                     local real_t *scratch)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  const uint pos = x + y*params->global_row_stride;
+  const bool inside = x < params->global_dims[0] && y < params->global_dims[1];
+
+  real_t val = 0.0f, pval = 0.0f;
+  if(inside && !on_edge(*params, x, y)) {
+    real_t wx, wy;
+    stencil_weights(*params, &wx, &wy);
+    pval = p[pos];
+    val = pval - stencil_sum(p, pos, params->global_row_stride, wx, wy);
+  }
+  if(inside) {
+    q[pos] = val;
+  }
+
+  cg_store_partial(partial, scratch, pval*val);
+}
+
+/* alpha = r.r/p.q */
+kernel void cg_alpha(constant params_t *params,
+                     global const real_t *partial,
+                     global real_t *scalars,
+                     local real_t *scratch)
+{
+  const real_t pq = cg_partial_total(params, partial, scratch);
+  if(get_local_id(0) == 0 && get_local_id(1) == 0) {
+    scalars[CG_PQ] = pq;
+    scalars[CG_ALPHA] = pq > 0.0f ? scalars[CG_RR]/pq : 0.0f;
+  }
+}
+
+/* u += alpha p, r -= alpha q, partial sums of the new r.r */
+kernel void cg_update(constant params_t *params,
+                      global const real_t *scalars,
+                      global const real_t *p,
+                      global const real_t *q,
+                      global real_t *u,
+                      global real_t *r,
+                      global real_t *partial,
+                      local real_t *scratch)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  const uint pos = x + y*params->global_row_stride;
+
+  real_t rval = 0.0f;
+  if(x < params->global_dims[0] && y < params->global_dims[1] &&
+      !on_edge(*params, x, y)) {
+    const real_t alpha = scalars[CG_ALPHA];
+    u[pos] += alpha*p[pos];
+    rval = r[pos] - alpha*q[pos];
+    r[pos] = rval;
+  }
+
+  cg_store_partial(partial, scratch, rval*rval);
+}
+
+/* beta = new r.r/old r.r */
+kernel void cg_beta(constant params_t *params,
+                    global const real_t *partial,
+                    global real_t *scalars,
+                    local real_t *scratch)
+{
+  const real_t rr = cg_partial_total(params, partial, scratch);
+  if(get_local_id(0) == 0 && get_local_id(1) == 0) {
+    const real_t old_rr = scalars[CG_RR];
+    scalars[CG_BETA] = old_rr > 0.0f ? rr/old_rr : 0.0f;
+    scalars[CG_RR] = rr;
+  }
+}
+
+/* p = r + beta p */
+kernel void cg_direction(constant params_t *params,
+                         global const real_t *scalars,
+                         global const real_t *r,
+                         global real_t *p)
+{
+  const uint x = get_global_id(0), y = get_global_id(1);
+  if(x >= params->global_dims[0] || y >= params->global_dims[1]) {
+    return;
+  }
+
+  const uint pos = x + y*params->global_row_stride;
+  p[pos] = r[pos] + scalars[CG_BETA]*p[pos];
+}
+
+/* Merge two partial residuals. The first component holds a sum of squares,
+ * the second the largest magnitude seen.
+ */
+real2_t residual_merge(real2_t a, real2_t b)
+{
+  return (real2_t)(a.x + b.x, fmax(a.y, b.y));
+}
+
+/* Tree reduction of one partial residual per work item held in scratch. Has to
+ * be reached by every work item of the group, leaves the result in scratch[0].
+ * The work group size does not need to be a power of two.
+ */
+void residual_tree(local real2_t *scratch)
+{
+  const uint lid = get_local_id(0);
+
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for(uint active = get_local_size(0); active > 1; ) {
+    const uint upper = (active + 1)/2;
+    if(lid + upper < active) {
+      scratch[lid] = residual_merge(scratch[lid], scratch[lid + upper]);
+    }
+    active = upper;
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+}
+
+/* First reduction stage: every work group folds a share of the differences
+ * into one partial residual. diffs has rows of width cells, stride apart, the
+ * padding at the end of each row is skipped. Run with a one dimensional
+ * range having as many groups as residual_finish has work items.
+ */
+kernel void residual_partial(uint width, uint stride, uint rows,
+                             global const real_t *diffs,
+                             global real2_t *partial,
+                             local real2_t *scratch)
+{
+  const uint count = width*rows;
+  real2_t acc = (real2_t)(0.0f, 0.0f);
+  for(uint i = get_global_id(0); i < count; i += get_global_size(0)) {
+    const real_t d = diffs[i%width + i/width*stride];
+    acc = residual_merge(acc, (real2_t)(d*d, fabs(d)));
+  }
+
+  scratch[get_local_id(0)] = acc;
+  residual_tree(scratch);
+
+  if(get_local_id(0) == 0) {
+    partial[get_group_id(0)] = scratch[0];
+  }
+}
+
+/* Second reduction stage: a single work group folds the partials down to the
+ * L2 and L-infinity norms of the differences.
+ */
+kernel void residual_finish(global const real2_t *partial,
+                            global float2 *result,
+                            local real2_t *scratch)
+{
+  scratch[get_local_id(0)] = partial[get_local_id(0)];
+  residual_tree(scratch);
+
+  if(get_local_id(0) == 0) {
+    result[0] = convert_float2((real2_t)(sqrt(scratch[0].x), scratch[0].y));
+  }
+}
 #endif /* HOST_INLCUSION */
+#endif /* LAPLACE_JAC_CL_INCLUDED */
 
 // vim: filetype=c
@@ -0,0 +1,241 @@
+#include <iostream>
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  /* Smoothing sweeps before and after the coarse grid correction. Both are
+   * even so the smoothed values always end up back in u.
+   */
+  const unsigned pre_sweeps = 2;
+  const unsigned post_sweeps = 2;
+
+  /* Params of the level below fine, with twice the spacing. Pairs of fine
+   * intervals make up the coarse ones, so an even number of cells leaves a
+   * single fine interval at the end, an odd one the last pair.
+   */
+  params_t coarsen(const params_t &fine)
+  {
+    params_t coarse = fine;
+    const float hx = (fine.xmax - fine.xmin)/fine.global_dims[0];
+    const float hy = (fine.ymax - fine.ymin)/fine.global_dims[1];
+    coarse.last_dx = fine.global_dims[0] % 2 ? hx + fine.last_dx :
+      fine.last_dx;
+    coarse.last_dy = fine.global_dims[1] % 2 ? hy + fine.last_dy :
+      fine.last_dy;
+    coarse.global_dims[0] = fine.global_dims[0]/2 + 1;
+    coarse.global_dims[1] = fine.global_dims[1]/2 + 1;
+    coarse.global_row_stride = padded_row_stride(coarse.global_dims[0]);
+    coarse.xmax = coarse.xmin + 2*(fine.xmax - fine.xmin)*
+      coarse.global_dims[0]/fine.global_dims[0];
+    coarse.ymax = coarse.ymin + 2*(fine.ymax - fine.ymin)*
+      coarse.global_dims[1]/fine.global_dims[1];
+
+    return coarse;
+  }
+
+  /* Kernels of a single level, and transfers between two levels */
+  typedef cl::kernel_functor<params_t, cl::buffer, cl::buffer, cl::buffer>
+    lattice_run;
+  typedef cl::kernel_functor<params_t, params_t, cl::buffer, cl::buffer>
+    transfer_run;
+
+  /* Kernel name bound to args, run over the lattice dims */
+  template<typename... Args>
+  cl::kernel_functor<Args...> bound_run(solver_env &env,
+      const std::string &name, const std::size_t dims[2],
+      const Args &... args)
+  {
+    cl::kernel_functor<Args...> run(env.get_kernel(name), 2, dims);
+    run.bind(args...);
+
+    return run;
+  }
+
+  /* Clears all of a lattice buffer on the device */
+  cl::buffer_fill zero_fill(const cl::buffer &b, std::size_t cells,
+      std::size_t real_size)
+  {
+    const double zero = 0.0;
+
+    return cl::buffer_fill(b, &zero, real_size, cells*real_size);
+  }
+
+  defaults::area lattice_area(const params_t &params)
+  {
+    defaults::area ret;
+    ret.dim[0] = params.global_dims[0];
+    ret.dim[1] = params.global_dims[1];
+
+    return ret;
+  }
+
+  /* Buffers and per-level kernels of one level of the hierarchy */
+  class level {
+    public:
+    params_t params;
+    defaults::area dims;
+    cl::buffer u, tmp, f, r;
+    lattice_run smooth_to_tmp, smooth_to_u, residual;
+    cl::buffer_fill zero_u, zero_f;
+
+    level(solver_env &env, const params_t &p, const cl::buffer &state)
+      : params(p)
+      , dims(lattice_area(p))
+      , u(state)
+      , tmp(env.lease(cells()*env.real_size))
+      , f(env.lease(cells()*env.real_size))
+      , r(env.lease(cells()*env.real_size))
+      , smooth_to_tmp(bound_run(env, "mg_smooth", dims.dim, params,
+            f, u, tmp))
+      , smooth_to_u(bound_run(env, "mg_smooth", dims.dim, params, f,
+            tmp, u))
+      , residual(bound_run(env, "mg_residual", dims.dim, params, f,
+            u, r))
+      , zero_u(zero_fill(u, cells(), env.real_size))
+      , zero_f(zero_fill(f, cells(), env.real_size))
+    {
+    }
+
+    std::size_t cells(void) const
+    {
+      return static_cast<std::size_t>(params.global_row_stride)*
+        params.global_dims[1];
+    }
+  };
+
+  /* Each step is one V-cycle followed by the fine level residual */
+  class multigrid : public sweeper {
+    private:
+    solver_env &env;
+    std::vector<level> levels;
+    /* Transfers between level n and n + 1, indexed by n */
+    std::vector<transfer_run> restrict_runs, prolong_runs;
+    std::vector<transfer_run> inject_runs, interpolate_runs;
+
+    template<typename Run>
+    cl::event add(const Run &run, const cl::event &after)
+    {
+      return run(env.queue, after);
+    }
+
+    cl::event add(const cl::buffer_fill &fill, const cl::event &after)
+    {
+      return env.queue.add(fill, after);
+    }
+
+    cl::event smooth(unsigned n, unsigned sweeps, cl::event ev)
+    {
+      for(unsigned i = 0; i < sweeps; i += 2) {
+        ev = add(levels[n].smooth_to_tmp, ev);
+        ev = add(levels[n].smooth_to_u, ev);
+      }
+
+      return ev;
+    }
+
+    /* Enough sweeps to solve the coarsest level outright */
+    unsigned coarse_sweeps(void) const
+    {
+      return 2*(levels.back().dims.dim[0] + levels.back().dims.dim[1]);
+    }
+
+    cl::event vcycle(unsigned n, cl::event ev)
+    {
+      if(n + 1 == levels.size()) {
+        return smooth(n, coarse_sweeps(), ev);
+      }
+
+      ev = smooth(n, pre_sweeps, ev);
+      ev = add(levels[n].residual, ev);
+      ev = add(restrict_runs[n], ev);
+      /* The coarse level solves for a correction, starting from zero */
+      ev = add(levels[n + 1].zero_u, ev);
+      ev = vcycle(n + 1, ev);
+      ev = add(prolong_runs[n], ev);
+
+      return smooth(n, post_sweeps, ev);
+    }
+
+    public:
+    multigrid(solver_env &e, const cl::buffer &state)
+      : env(e)
+    {
+      levels.push_back(level(env, env.params, state));
+      while(levels.back().params.global_dims[0] >= 5 &&
+          levels.back().params.global_dims[1] >= 5) {
+        const params_t p = coarsen(levels.back().params);
+        levels.push_back(level(env, p,
+              env.lease(p.global_row_stride*p.global_dims[1]*env.real_size)));
+      }
+
+      for(unsigned n = 0; n + 1 < levels.size(); ++n) {
+        level &fine = levels[n], &coarse = levels[n + 1];
+        restrict_runs.push_back(bound_run(env, "mg_restrict",
+              coarse.dims.dim, fine.params, coarse.params, fine.r, coarse.f));
+        prolong_runs.push_back(bound_run(env, "mg_prolong",
+              fine.dims.dim, fine.params, coarse.params, coarse.u, fine.u));
+        interpolate_runs.push_back(bound_run(env, "mg_interpolate",
+              fine.dims.dim, fine.params, coarse.params, coarse.u, fine.u));
+        inject_runs.push_back(bound_run(env, "mg_inject",
+              coarse.dims.dim, fine.params, coarse.params, fine.u, coarse.u));
+      }
+
+      if(defaults::get().verbose()) {
+        std::cerr << "Multigrid hierarchy of " << levels.size() <<
+          " levels, coarsest " << levels.back().dims.dim[0] << 'x' <<
+          levels.back().dims.dim[1] << std::endl;
+      }
+    }
+
+    //! Full multigrid: solve the coarsest level, then work upwards
+    /*! Every level starts from the interpolated solution of the level below
+     *  and gets one V-cycle.
+     */
+    cl::event full(cl::event ev)
+    {
+      for(unsigned n = 0; n < levels.size(); ++n) {
+        ev = add(levels[n].zero_f, ev);
+      }
+      /* Carry the boundary values down the hierarchy */
+      for(unsigned n = 0; n + 1 < levels.size(); ++n) {
+        ev = add(inject_runs[n], ev);
+      }
+
+      ev = smooth(levels.size() - 1, coarse_sweeps(), ev);
+      for(unsigned n = levels.size() - 1; n-- > 0; ) {
+        ev = add(interpolate_runs[n], ev);
+        ev = vcycle(n, ev);
+      }
+
+      return ev;
+    }
+
+    cl::event step(cl::queue &, unsigned, const cl::event &after)
+    {
+      return add(levels.front().residual, vcycle(0, after));
+    }
+
+    //! Fine level residual, up to date after every step
+    const cl::buffer &residual(void) const
+    {
+      return levels.front().r;
+    }
+  };
+}
+
+solve_result solve_multigrid(solver_env &env, const cl::buffer &state,
+    const cl::event &start)
+{
+  multigrid mg(env, state);
+  residual_monitor residual(env, mg.residual(),
+      env.params.global_dims[0], env.params.global_row_stride,
+      env.params.global_dims[1],
+      defaults::get().local_size().dim[0]*defaults::get().local_size().dim[1]);
+
+  /* A V-cycle does the work of many sweeps, so check after every one */
+  solve_result result(state);
+  iterate(env, mg, residual, mg.full(start), 1, result);
+
+  return result;
+}
@@ -0,0 +1,80 @@
+#include <string>
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  /* The first stage runs group_size groups of group_size work items each so
+   * that the second stage can fold all partials in a single group.
+   */
+  template<typename... Args>
+  cl::kernel_functor<Args...> make_run(solver_env &env,
+      const std::string &name, std::size_t groups, std::size_t group_size)
+  {
+    std::size_t global[1] = { groups*group_size };
+    std::size_t local[1] = { group_size };
+
+    return cl::kernel_functor<Args...>(env.get_kernel(name), 1, global,
+        local);
+  }
+}
+
+residual_monitor::residual_monitor(solver_env &env, const cl::buffer &diffs,
+    std::size_t width, std::size_t stride, std::size_t rows,
+    std::size_t group_size)
+  : partial(env.lease(2*env.real_size*group_size))
+  , result(env.lease(2*sizeof(float), cl::mem::MEM_MODE_WO))
+  , run_partial(make_run<uint32_t, uint32_t, uint32_t, cl::buffer, cl::buffer,
+      cl::local_space>(env, "residual_partial", group_size, group_size))
+  , run_finish(make_run<cl::buffer, cl::buffer, cl::local_space>(env,
+        "residual_finish", 1, group_size))
+  , pending()
+{
+  run_partial.bind(static_cast<uint32_t>(width),
+      static_cast<uint32_t>(stride), static_cast<uint32_t>(rows), diffs,
+      partial, cl::local_space(2*env.real_size*group_size));
+  run_finish.bind(partial, result,
+      cl::local_space(2*env.real_size*group_size));
+  norms[0] = norms[1] = 0.0f;
+}
+
+residual_monitor::~residual_monitor(void)
+{
+}
+
+cl::event residual_monitor::check(cl::queue &q, const cl::event &after)
+{
+  /* The partials may only be overwritten once the previous check is done
+   * with them.
+   */
+  cl::wait_list waitlist(pending);
+  waitlist.push_back(after);
+
+  cl::event reduced = run_partial(q, waitlist);
+  cl::event finished = run_finish(q, reduced);
+  pending.clear();
+  pending.push_back(q.add(cl::buffer_read(result, norms, sizeof(norms)),
+        finished));
+
+  return reduced;
+}
+
+bool residual_monitor::pending_check(void) const
+{
+  return !pending.empty();
+}
+
+void residual_monitor::wait(void)
+{
+  cl::event::wait_all(pending);
+  pending.clear();
+}
+
+float residual_monitor::l2(void) const
+{
+  return norms[0];
+}
+
+float residual_monitor::linf(void) const
+{
+  return norms[1];
+}
@@ -0,0 +1,51 @@
+#ifndef RESIDUAL_HH_INCLUDED
+#define RESIDUAL_HH_INCLUDED
+
+#include <stdint.h>
+#include "clpp/clpp.hh"
+
+/* Reduces a buffer of per-cell differences to its L2 and L-infinity norms on
+ * the device. Only the two norms come back to the host, and the read back is
+ * non-blocking so the solver can keep the queue full while it is in flight.
+ */
+class solver_env;
+
+class residual_monitor {
+  private:
+  cl::buffer partial;
+  cl::buffer result;
+  cl::kernel_functor<uint32_t, uint32_t, uint32_t, cl::buffer, cl::buffer,
+    cl::local_space> run_partial;
+  cl::kernel_functor<cl::buffer, cl::buffer, cl::local_space> run_finish;
+  /* Host copy of the last read back, L2 then L-infinity */
+  float norms[2];
+  /* Read back event of the last check, if any is outstanding */
+  cl::wait_list pending;
+
+  public:
+  //! Setup to monitor rows of width elements of diffs, stride apart
+  /*! group_size is the number of work items used for each reduction work
+   *  group. The elements of diffs are the real_t of env.
+   */
+  residual_monitor(solver_env &env, const cl::buffer &diffs,
+      std::size_t width, std::size_t stride, std::size_t rows,
+      std::size_t group_size);
+  ~residual_monitor(void);
+
+  //! Enqueue a reduction of the differences once after has completed
+  /*! Returns the event which has to complete before diffs may be written
+   *  again.
+   */
+  cl::event check(cl::queue &q, const cl::event &after);
+
+  //! Determine if a check is outstanding
+  bool pending_check(void) const;
+
+  //! Wait for the outstanding check to be read back
+  void wait(void);
+
+  float l2(void) const;
+  float linf(void) const;
+};
+
+#endif /* RESIDUAL_HH_INCLUDED */
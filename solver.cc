@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <iostream>
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+pval_uint_t padded_row_stride(pval_uint_t width)
+{
+  const pval_uint_t line = 16;
+
+  return (width + line - 1)/line*line;
+}
+
+void stencil_weights(const params_t &params, double &wx, double &wy)
+{
+  const double dx = (params.xmax - params.xmin)/params.global_dims[0];
+  const double dy = (params.ymax - params.ymin)/params.global_dims[1];
+
+  wx = dy*dy/(2*(dx*dx + dy*dy));
+  wy = dx*dx/(2*(dx*dx + dy*dy));
+}
+
+solver_env::solver_env(const cl::context &c,
+    const std::vector<cl::queue> &qs, const cl::program &p,
+    cl::program_cache &pc, cl::buffer_pool &bp,
+    const std::vector<params_t> &probs, std::size_t rsize)
+  : context(c)
+  , queues(qs)
+  , queue(qs.front())
+  , program(p)
+  , kernels(pc)
+  , pool(bp)
+  , problems(probs)
+  , params(probs.front())
+  , params_buf(lease(probs.size()*sizeof(params_t), cl::mem::MEM_MODE_RO))
+  , real_size(rsize)
+{
+  queue.add(cl::buffer_write(params_buf, &problems[0],
+        problems.size()*sizeof(params_t)));
+}
+
+solver_env::~solver_env(void)
+{
+  /* Commands may still use the leased buffers, so the pool holds them back
+   * until everything enqueued so far has completed.
+   */
+  try {
+    std::vector<cl::event> done;
+    for(std::size_t i = 0; i < queues.size(); ++i) {
+      done.push_back(queues[i].marker());
+    }
+    for(std::size_t l = 0; l < leases.size(); ++l) {
+      for(std::size_t i = 0; i < done.size(); ++i) {
+        leases[l].retire_after(done[i]);
+      }
+    }
+  } catch(cl::error &e) {
+    std::cerr << "unable to mark the end of solver commands: " << e.what() <<
+      std::endl;
+  }
+}
+
+cl::kernel solver_env::get_kernel(const std::string &name)
+{
+  return kernels.get_kernel(program, name, instances[name]++);
+}
+
+std::size_t solver_env::cells(void) const
+{
+  return static_cast<std::size_t>(params.global_row_stride)*
+    params.global_dims[1];
+}
+
+std::size_t solver_env::lattice_bytes(void) const
+{
+  return cells()*real_size*problems.size();
+}
+
+cl::buffer solver_env::lease(std::size_t cb, cl::mem::mem_mode m,
+    cl::mem::mem_host h)
+{
+  leases.push_back(pool.acquire(cb, m, h));
+
+  return leases.back().get();
+}
+
+cl::buffer solver_env::lattice_buffer(void)
+{
+  return lease(lattice_bytes(), cl::mem::MEM_MODE_RW,
+      defaults::get().lattice_memory());
+}
+
+cl::nd_run batch_run(const solver_env &env, const cl::kernel &k,
+    const std::size_t size[2], const std::size_t *local)
+{
+  const std::size_t global[3] = { size[0], size[1], env.problems.size() };
+  if(!local) {
+    return cl::nd_run(k, 3, global);
+  }
+
+  const std::size_t group[3] = { local[0], local[1], 1 };
+  return cl::nd_run(k, 3, global, group);
+}
+
+solve_result::solve_result(const cl::buffer &s)
+  : state(s)
+  , iterations(0)
+  , converged(false)
+  , l2(0.0f)
+  , linf(0.0f)
+{
+}
+
+solve_result::~solve_result(void)
+{
+}
+
+sweeper::~sweeper(void)
+{
+}
+
+void sweeper::enqueue(cl::queue &q, unsigned n)
+{
+  step(q, n, q.marker());
+}
+
+cl::event sweeper::steps(cl::queue &q, unsigned n, unsigned count,
+    const cl::event &after)
+{
+  const bool in_order = !(q.properties() & cl::queue::QUEUE_OUT_OF_ORDER);
+  cl::event ev = after;
+  for(unsigned i = 0; i < count; ++i) {
+    if(in_order && i + 1 < count) {
+      enqueue(q, n + i);
+    } else {
+      ev = step(q, n + i, ev);
+    }
+  }
+
+  return ev;
+}
+
+unsigned sweeper::iterations_per_step(void) const
+{
+  return 1;
+}
+
+void iterate(solver_env &env, sweeper &s, residual_monitor &residual,
+    const cl::event &start, unsigned check_interval, solve_result &result)
+{
+  const unsigned max_iterations = defaults::get().max_iterations();
+  const unsigned per_step = s.iterations_per_step();
+  unsigned steps = 0, checked = 0, next_check = check_interval;
+  cl::event ev = start;
+
+  result.iterations = 0;
+  result.converged = false;
+  while(!result.converged && result.iterations < max_iterations) {
+    /* All steps up to the next check go out at once */
+    const unsigned count = (std::min(next_check, max_iterations) -
+        result.iterations + per_step - 1)/per_step;
+    ev = s.steps(env.queue, steps, count, ev);
+    steps += count;
+    result.iterations += count*per_step;
+    while(next_check <= result.iterations) {
+      next_check += check_interval;
+    }
+    if(residual.pending_check()) {
+      residual.wait();
+      result.converged = residual.linf() <= defaults::get().tolerance();
+      if(defaults::get().verbose()) {
+        std::cerr << "Iteration " << checked << ": L2 residual " <<
+          residual.l2() << ", max residual " << residual.linf() << std::endl;
+      }
+    }
+    ev = residual.check(env.queue, ev);
+    checked = result.iterations;
+  }
+  ev.wait();
+  residual.wait();
+
+  result.l2 = residual.l2();
+  result.linf = residual.linf();
+  /* The last check covers the final state */
+  result.converged = result.linf <= defaults::get().tolerance();
+}
@@ -0,0 +1,164 @@
+#ifndef SOLVER_HH_INCLUDED
+#define SOLVER_HH_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+#include "clpp/clpp.hh"
+
+// Obtain standard sized integers
+#include <stdint.h>
+
+// Grab the param_t structure
+#define HOST_INCLUSION
+#include "laplace_jac.cl"
+
+class residual_monitor;
+
+//! Weights of the horizontal and vertical neighbours in the five point stencil
+void stencil_weights(const params_t &params, double &wx, double &wy);
+
+//! Row stride of a lattice with rows of width cells
+/*! Rows are padded to whole 16 cells, a 64 byte line in single precision, so
+ *  that each row starts aligned for coalesced and vector accesses.
+ */
+pval_uint_t padded_row_stride(pval_uint_t width);
+
+/* Device objects shared by all solvers */
+class solver_env {
+  private:
+  /* Buffers leased by the env, first so they outlast all other members */
+  std::vector<cl::buffer_pool::lease> leases;
+  /* Kernels of each name handed out so far */
+  std::map<std::string, unsigned> instances;
+
+  public:
+  cl::context context;
+  //! One queue per device of the context
+  std::vector<cl::queue> queues;
+  //! Queue of the first device, which all solvers but bands run on
+  cl::queue queue;
+  cl::program program;
+  //! Cache the kernels of program come from, shared by successive envs
+  cl::program_cache &kernels;
+  //! Pool all buffers of a solve are leased from
+  cl::buffer_pool &pool;
+  //! Parameters of every problem solved together
+  /*! The problems share the lattice and differ in their boundary data, each
+   *  lattice buffer stacks one lattice per problem.
+   */
+  std::vector<params_t> problems;
+  //! Parameters of the first problem
+  params_t params;
+  //! Device copy of problems
+  cl::buffer params_buf;
+  //! Size of a lattice value in bytes, the real_t the program was built with
+  std::size_t real_size;
+
+  solver_env(const cl::context &c, const std::vector<cl::queue> &qs,
+      const cl::program &p, cl::program_cache &pc, cl::buffer_pool &bp,
+      const std::vector<params_t> &probs, std::size_t rsize);
+  ~solver_env(void);
+
+  //! Lease a buffer of at least cb bytes, held until the env goes
+  cl::buffer lease(std::size_t cb, cl::mem::mem_mode m = cl::mem::MEM_MODE_RW,
+      cl::mem::mem_host h = cl::mem::MEM_HOST_NONE);
+
+  //! A kernel of program not handed out before by this env
+  /*! Each call gets a kernel of its own to bind, and the next env over the
+   *  same cache gets the same kernels again, so repeated solves create none.
+   */
+  cl::kernel get_kernel(const std::string &name);
+
+  //! Number of values in a lattice, including the row padding
+  std::size_t cells(void) const;
+  //! Bytes of a lattice buffer, holding the lattices of the whole batch
+  std::size_t lattice_bytes(void) const;
+  //! Lease a lattice buffer, in the memory selected by the defaults
+  cl::buffer lattice_buffer(void);
+};
+
+//! Range covering size cells of every problem of the batch
+/*! local gives the work group size in the lattice dimensions, or is null to
+ *  let the implementation choose.
+ */
+cl::nd_run batch_run(const solver_env &env, const cl::kernel &k,
+    const std::size_t size[2], const std::size_t *local = 0);
+
+/* Outcome of a solve */
+class solve_result {
+  public:
+  //! Buffer holding the final lattice
+  cl::buffer state;
+  unsigned iterations;
+  bool converged;
+  float l2, linf;
+
+  explicit solve_result(const cl::buffer &s);
+  ~solve_result(void);
+};
+
+/* One step of an iterative solver */
+class sweeper {
+  public:
+  virtual ~sweeper(void);
+
+  //! Enqueue step number n once after has completed
+  /*! Returns the event signalling completion of the step. */
+  virtual cl::event step(cl::queue &q, unsigned n, const cl::event &after) = 0;
+
+  //! Enqueue step number n on an in-order queue, without events
+  /*! The default chains step() onto a marker. */
+  virtual void enqueue(cl::queue &q, unsigned n);
+
+  //! Enqueue count steps from step number n once after has completed
+  /*! Returns the event signalling completion of the last step. The default
+   *  chains step(), or on an in-order queue issues enqueue() for all but the
+   *  last step.
+   */
+  virtual cl::event steps(cl::queue &q, unsigned n, unsigned count,
+      const cl::event &after);
+
+  //! Number of iterations each step accounts for
+  virtual unsigned iterations_per_step(void) const;
+};
+
+//! Run steps until converged or out of iterations
+/*! Every check_interval iterations the residual enqueued one interval
+ *  earlier is inspected and a new one is enqueued, so the host never waits on
+ *  the steps in between, which are enqueued together through
+ *  sweeper::steps().
+ */
+void iterate(solver_env &env, sweeper &s, residual_monitor &residual,
+    const cl::event &start, unsigned check_interval, solve_result &result);
+
+/* The solvers below start once the event start, which initialized state,
+ * has completed.
+ */
+
+//! Jacobi iteration, ping-pong or in place
+solve_result solve_jacobi(solver_env &env, const cl::buffer &state,
+    const cl::buffer &diffs, const cl::event &start);
+
+//! Red-black successive over-relaxation
+solve_result solve_sor(solver_env &env, const cl::buffer &state,
+    const cl::event &start);
+//! Optimal SOR relaxation factor for the lattice described by params
+float sor_omega(const params_t &params);
+
+//! Geometric multigrid, full multigrid start followed by V-cycles
+solve_result solve_multigrid(solver_env &env, const cl::buffer &state,
+    const cl::event &start);
+
+//! Matrix-free conjugate gradients, resident on the device
+solve_result solve_cg(solver_env &env, const cl::buffer &state,
+    const cl::event &start);
+
+//! Jacobi iteration of horizontal bands, one per queue of env
+/*! Each band sweeps its rows on its own queue and swaps edge rows with its
+ *  neighbours after every sweep. Needs a single problem.
+ */
+solve_result solve_bands(solver_env &env, const cl::buffer &state,
+    const cl::event &start);
+
+#endif /* SOLVER_HH_INCLUDED */
@@ -0,0 +1,96 @@
+#include <cmath>
+#include "defaults.hh"
+#include "residual.hh"
+#include "solver.hh"
+
+namespace {
+  cl::kernel bound_sor_kernel(solver_env &env, const std::string &name,
+      const cl::buffer &a, const cl::buffer &b, const cl::buffer &c)
+  {
+    cl::kernel k = env.get_kernel(name);
+    k.argv()[0] <<= env.params_buf;
+    k.argv()[1] <<= a;
+    k.argv()[2] <<= b;
+    k.argv()[3] <<= c;
+
+    return k;
+  }
+
+  /* A full iteration is a red half sweep followed by a black one */
+  class sor_sweeper : public sweeper {
+    private:
+    cl::nd_run red_run;
+    cl::nd_run black_run;
+    cl::command_list iteration;
+
+    public:
+    sor_sweeper(const cl::nd_run &r, const cl::nd_run &b)
+      : red_run(r), black_run(b)
+    {
+      iteration.add(red_run);
+      iteration.add(black_run, cl::command_list::dependencies(1, 0));
+    }
+
+    cl::event step(cl::queue &q, unsigned, const cl::event &after)
+    {
+      cl::event red_done = q.add(red_run, after);
+      return q.add(black_run, red_done);
+    }
+
+    cl::event steps(cl::queue &q, unsigned, unsigned count,
+        const cl::event &after)
+    {
+      return iteration.replay(q, count, after);
+    }
+  };
+}
+
+float sor_omega(const params_t &params)
+{
+  double wx, wy;
+  stencil_weights(params, wx, wy);
+
+  /* Spectral radius of the Jacobi iteration for the Dirichlet problem on
+   * this lattice, from which the classic optimum follows.
+   */
+  const double rho = 2*wx*std::cos(M_PI/(params.global_dims[0] - 1)) +
+    2*wy*std::cos(M_PI/(params.global_dims[1] - 1));
+
+  return 2/(1 + std::sqrt(1 - rho*rho));
+}
+
+solve_result solve_sor(solver_env &env, const cl::buffer &state,
+    const cl::event &start)
+{
+  std::size_t half_dims[2] = {
+    (env.params.global_row_stride + 1)/2,
+    env.params.global_dims[1]
+  };
+  const std::size_t half_cells = half_dims[0]*half_dims[1];
+
+  cl::buffer red = env.lease(half_cells*env.real_size);
+  cl::buffer black = env.lease(half_cells*env.real_size);
+  cl::buffer diffs = env.lease(2*half_cells*env.real_size);
+
+  cl::nd_run split(bound_sor_kernel(env, "sor_split", state, red, black),
+      defaults::get().global_size().dim, defaults::get().local_size().dim);
+  cl::nd_run merge(bound_sor_kernel(env, "sor_merge", red, black, state),
+      defaults::get().global_size().dim, defaults::get().local_size().dim);
+  sor_sweeper sweeps(
+      cl::nd_run(bound_sor_kernel(env, "sor_red_step", red, black, diffs),
+        half_dims),
+      cl::nd_run(bound_sor_kernel(env, "sor_black_step", black, red, diffs),
+        half_dims));
+
+  residual_monitor residual(env, diffs,
+      2*half_cells, 2*half_cells, 1,
+      defaults::get().local_size().dim[0]*defaults::get().local_size().dim[1]);
+
+  solve_result result(state);
+  iterate(env, sweeps, residual,
+      env.queue.add(split, start),
+      defaults::get().check_interval(), result);
+  env.queue.add(merge).wait();
+
+  return result;
+}